@@ -1,5 +1,4 @@
 #include <cstdint>
-#include <fstream>
 #include <iostream>
 
 #include <pybind11/pybind11.h>
@@ -9,6 +8,7 @@
 #include "pybind_json.hpp"
 
 #include "framework.hpp"
+#include "utils/file_helpers.hpp"
 #include "nlohmann/json.hpp"
 
 namespace py = pybind11;
@@ -27,6 +27,7 @@ void bind_framework_network(py::module &m)
     using neuro::Node;
     using neuro::Edge;
     using neuro::Network;
+    using neuro::NetworkGraph;
 
 	typedef std::pair<int,int> Coords;
 
@@ -88,16 +89,15 @@ void bind_framework_network(py::module &m)
 		.def(py::self != py::self);
 
 	py::class_<Node>(m, "Node")
-		.def(py::init<uint32_t, Network*>(), py::arg("idx"), py::arg("n") = nullptr)
+		.def(py::init<uint32_t>(), py::arg("idx"))
 		.def_readonly("id", &Node::id)
 		.def_readonly("input_id", &Node::input_id)
 		.def_readonly("output_id", &Node::output_id)
-		.def_readonly("net", &Node::net)
-		.def_readonly("values", &Node::values)
+		.def_property_readonly("values", [](const Node &n) { return n.values.to_vector(); })
 		.def_readwrite("incoming", &Node::incoming, py::return_value_policy::reference)
 		.def_readwrite("outgoing", &Node::outgoing, py::return_value_policy::reference)
-		.def_readwrite("coordinates", &Node::coordinates)
-		.def_readwrite("name", &Node::name)
+		.def_property("coordinates", &Node::get_coordinates, &Node::set_coordinates)
+		.def_property("name", &Node::get_name, &Node::set_name)
 		.def("set", py::overload_cast<int, double>(&Node::set))
 		.def("set", py::overload_cast<const string&, double>(&Node::set))
 		.def("get", py::overload_cast<int>(&Node::get))
@@ -107,15 +107,14 @@ void bind_framework_network(py::module &m)
 		.def("is_output", &Node::is_output);
 	
 	py::class_<Edge>(m, "Edge")
-		.def(py::init<Node*, Node*, Network*>(), py::arg("f"), py::arg("to"), py::arg("net"))
+		.def(py::init<Node*, Node*>(), py::arg("f"), py::arg("to"))
 		.def_readonly("from", &Edge::from)
 		.def_readonly("to", &Edge::to)
 		.def_readonly("pre", &Edge::from)
         .def_readonly("post", &Edge::to)
-		.def_readonly("net", &Edge::net)
-		.def_readonly("values", &Edge::values)
+		.def_property_readonly("values", [](const Edge &e) { return e.values.to_vector(); })
 		.def("as_json", &Edge::as_json)
-		.def_readwrite("control_point", &Edge::control_point)
+		.def_property("control_point", &Edge::get_control_point, &Edge::set_control_point)
 		.def("set", py::overload_cast<int, double>(&Edge::set))
 		.def("set", py::overload_cast<const string&, double>(&Edge::set))
 		.def("get", py::overload_cast<int>(&Edge::get))
@@ -124,24 +123,31 @@ void bind_framework_network(py::module &m)
 	py::class_<Network>(m, "Network")
 		.def(py::init<>())
 		.def("__eq__", &Network::operator==)
+		.def("content_hash", &Network::content_hash, py::arg("include_metadata") = false)
 
 		.def("read_from_file", [](Network &net, const string& fname) {
-            std::ifstream fs(fname);
+            neuro::InputFile fs(fname);
             json j;
+            if (fs.fail()) throw std::runtime_error("Network.read_from_file(): Cannot open " + fname);
             fs >> j;
             return net.from_json(j);
         })
 
         .def("write_to_file", [](const Network &net, const string& fname) {
-            json j = net.as_json();
-            std::ofstream fs(fname);
-            fs << j;
+            neuro::OutputFile fs(fname);
+            if (fs.fail()) throw std::runtime_error("Network.write_to_file(): Cannot open " + fname);
+            net.write_json(fs);
+            fs.close();
+            if (fs.fail()) throw std::runtime_error("Network.write_to_file(): write failed.");
         })
 
 		.def("clear", &Network::clear)
 		.def("to_json", &Network::to_json)
 		.def("as_json", &Network::as_json)
 		.def("from_json", &Network::from_json)
+		.def("save_binary", (void (Network::*)(const string&) const) &Network::save_binary)
+		.def("load_binary", (void (Network::*)(const string&)) &Network::load_binary)
+		.def_static("is_binary_file", &Network::is_binary_file)
 		.def("pretty_json", &Network::pretty_json)
 		.def("pretty_nodes", &Network::pretty_nodes)
 		.def("pretty_edges", &Network::pretty_edges)
@@ -155,31 +161,31 @@ void bind_framework_network(py::module &m)
 		.def("get_network_property", &Network::get_network_property, py::return_value_policy::reference)
 		.def("add_node", &Network::add_node, py::return_value_policy::reference)
 		.def("is_node", &Network::is_node)
-		.def("get_node", &Network::get_node, py::return_value_policy::reference)
+		.def("get_node", py::overload_cast<uint32_t>(&Network::get_node), py::return_value_policy::reference)
 		.def("add_or_get_node", &Network::add_or_get_node)
 		.def("remove_node", &Network::remove_node)
 		.def("rename_node", &Network::rename_node)
 		.def("add_edge", &Network::add_edge, py::return_value_policy::reference)
 		.def("is_edge", &Network::is_edge)
-		.def("get_edge", &Network::get_edge, py::return_value_policy::reference)
+		.def("get_edge", py::overload_cast<uint32_t, uint32_t>(&Network::get_edge), py::return_value_policy::reference)
 		.def("add_or_get_edge", &Network::add_or_get_edge, py::return_value_policy::reference)
 		.def("remove_edge", &Network::remove_edge)
 
 		.def("add_input", &Network::add_input)
-		.def("get_input", &Network::get_input, py::return_value_policy::reference)
+		.def("get_input", py::overload_cast<int>(&Network::get_input), py::return_value_policy::reference)
 		.def("num_inputs", &Network::num_inputs)
 		.def("add_output", &Network::add_output)
-		.def("get_output", &Network::get_output, py::return_value_policy::reference)
+		.def("get_output", py::overload_cast<int>(&Network::get_output), py::return_value_policy::reference)
 		.def("num_outputs", &Network::num_outputs)
 
 		.def("set_data", &Network::set_data)
 		.def("get_data", &Network::get_data)
 		.def("data_keys", &Network::data_keys)
 
-		.def("get_random_node", &Network::get_random_node)
-		.def("get_random_edge", &Network::get_random_edge)
-		.def("get_random_input", &Network::get_random_input)
-		.def("get_random_output", &Network::get_random_output)
+		.def("get_random_node", py::overload_cast<neuro::MOA&>(&Network::get_random_node))
+		.def("get_random_edge", py::overload_cast<neuro::MOA&>(&Network::get_random_edge))
+		.def("get_random_input", py::overload_cast<neuro::MOA&>(&Network::get_random_input))
+		.def("get_random_output", py::overload_cast<neuro::MOA&>(&Network::get_random_output))
 
 		.def("randomize_properties", py::overload_cast<neuro::MOA&>(&Network::randomize_properties))
 		.def("randomize_properties", py::overload_cast<neuro::MOA&, Node*>(&Network::randomize_properties))
@@ -190,7 +196,8 @@ void bind_framework_network(py::module &m)
 		.def("randomize_property", py::overload_cast<neuro::MOA&, Edge*, const string&>(&Network::randomize_property))
 		.def("randomize_property", py::overload_cast<neuro::MOA&, const Property&, std::vector<double>&>(&Network::randomize_property))
 
-		.def("randomize", &Network::randomize)
+		.def("randomize", py::overload_cast<const json&>(&Network::randomize))
+		.def("randomize", py::overload_cast<neuro::MOA&, const json&>(&Network::randomize))
 		.def("prune", &Network::prune)
 		.def("make_sorted_node_vector", &Network::make_sorted_node_vector)
 		.def_readonly("sorted_node_vector", &Network::sorted_node_vector)
@@ -212,7 +219,7 @@ void bind_framework_network(py::module &m)
 		.def("num_nodes", &Network::num_nodes)
 		.def("num_edges", &Network::num_edges)
 
-		.def("__getitem__", [](const Network &net, int key) {
+		.def("__getitem__", [](Network &net, int key) {
             return net.get_node(key);
         }, py::return_value_policy::reference_internal)
 
@@ -227,4 +234,22 @@ void bind_framework_network(py::module &m)
         }, py::keep_alive<0, 1>())
 
 		.def_readonly("values", &Network::values);
+
+	py::class_<NetworkGraph>(m, "NetworkGraph")
+		.def(py::init<Network *, const string &>(), py::arg("net"), py::arg("delay_property") = "Delay",
+		     py::keep_alive<1, 2>())
+		.def("size", &NetworkGraph::size)
+		.def("index", &NetworkGraph::index)
+		.def_readonly("nodes", &NetworkGraph::nodes, py::return_value_policy::reference_internal)
+		.def("from_inputs", &NetworkGraph::from_inputs)
+		.def("to_outputs", &NetworkGraph::to_outputs)
+		.def("components", &NetworkGraph::components)
+		.def("is_feed_forward", &NetworkGraph::is_feed_forward)
+		.def("depths", &NetworkGraph::depths)
+		.def("shortest_delays", &NetworkGraph::shortest_delays)
+		.def("longest_delays", &NetworkGraph::longest_delays)
+		.def("shortest_io_delay", &NetworkGraph::shortest_io_delay)
+		.def("longest_io_delay", &NetworkGraph::longest_io_delay)
+		.def("fan_in_histogram", &NetworkGraph::fan_in_histogram)
+		.def("fan_out_histogram", &NetworkGraph::fan_out_histogram);
 }
@@ -39,4 +39,16 @@ void bind_processor_help(py::module &m) {
 
 	m.def("pull_network", &neuro::pull_network,
 		py::arg("p"), py::arg("n"), py::arg("network_id") = 0);
+
+	/* The GIL is released while the files load, but not around load_networks(),
+	   since the processor may be written in Python. */
+
+	py::class_<NetworkBatchLoader>(m, "NetworkBatchLoader")
+		.def(py::init<int, size_t>(), py::arg("max_threads") = 0, py::arg("max_bytes") = 0)
+		.def("load", &NetworkBatchLoader::load, py::arg("filenames"),
+		     py::call_guard<py::gil_scoped_release>(), py::return_value_policy::take_ownership)
+		.def("load_networks", &NetworkBatchLoader::load_networks, py::arg("p"), py::arg("filenames"),
+		     py::return_value_policy::take_ownership)
+		.def_readwrite("max_threads", &NetworkBatchLoader::max_threads)
+		.def_readwrite("max_bytes", &NetworkBatchLoader::max_bytes);
 }
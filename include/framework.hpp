@@ -4,9 +4,15 @@
 
 #include <vector>
 #include <map>
+#include <list>
+#include <unordered_map>
 #include <memory>
+#include <iterator>
+#include <cstddef>
 #include <exception>
 #include <stdexcept>
+#include <istream>
+#include <ostream>
 
 #include "robinhood/robin_map.h"
 #include "nlohmann/json.hpp"
@@ -39,6 +45,7 @@ class PropertyPack;
 class Node;
 class Edge;
 class Network;
+class NetworkTopology;
 class Processor;
 struct Spike;
 
@@ -80,9 +87,89 @@ public:
     }
 };
 
+/**
+ * Slab storage for the nodes and edges of a network, so that building a network
+ * doesn't call malloc once per node and edge.  Objects never move, slots freed by
+ * release() are reused, and clear() frees all of the slabs at once.
+ */
+template <class T>
+class Arena
+{
+public:
+    Arena() = default;
+    Arena(const Arena &a) = delete;
+    Arena(Arena &&a) { *this = std::move(a); }
+    Arena& operator=(const Arena &a) = delete;
+
+    Arena& operator=(Arena &&a)     /**< Take a's slabs, leaving a empty but usable */
+    {
+        if (&a == this) return *this;
+        slabs = std::move(a.slabs);
+        free_slots = std::move(a.free_slots);
+        slab_size = a.slab_size;
+        used = a.used;
+        next_size = a.next_size;
+        dropping = false;
+        a.clear();
+        return *this;
+    }
+
+    void *allocate()                /**< Raw memory for one T */
+    {
+        void *p;
+
+        if (!free_slots.empty()) {
+            p = free_slots.back();
+            free_slots.pop_back();
+            return p;
+        }
+        if (used == slab_size) {
+            slab_size = (next_size > slab_size) ? next_size : slab_size * 2;
+            if (slab_size < 64) slab_size = 64;
+            if (slab_size > 65536 && next_size <= 65536) slab_size = 65536;
+            next_size = 0;
+            slabs.emplace_back(new char[slab_size * sizeof(T)]);
+            used = 0;
+        }
+        return slabs.back().get() + sizeof(T) * used++;
+    }
+
+    void release(T *p)              /**< Return the slot of an already destroyed T */
+        { if (!dropping) free_slots.push_back(p); }
+
+    void drop()                     /**< Ignore release() until clear(), which is coming */
+        { dropping = true; }
+
+    void reserve(size_t n)          /**< Make the next slab hold at least n more */
+        { if (n > slab_size - used) next_size = n; }
+
+    void clear()                    /**< Free every slab.  The objects must be destroyed. */
+    {
+        slabs.clear();
+        free_slots.clear();
+        slab_size = 0;
+        used = 0;
+        next_size = 0;
+        dropping = false;
+    }
+
+protected:
+    vector <unique_ptr<char[]>> slabs;
+    vector <void *> free_slots;
+    size_t slab_size = 0;           /**< Number of T's in the last slab */
+    size_t used = 0;                /**< Number of those that have been handed out */
+    size_t next_size = 0;           /**< Set by reserve() */
+    bool dropping = false;          /**< Set by drop() */
+};
+
+/* Nodes and edges live in their network's arenas, so these put them back. */
+
+struct NodeDeleter { void operator()(Node *n) const; };
+struct EdgeDeleter { void operator()(Edge *e) const; };
+
 /* Use Hash Tables for storing a sparse collection of nodes / edges */
-typedef tsl::robin_map<uint32_t, unique_ptr<Node>, int_hash> NodeMap;
-typedef tsl::robin_map<Coords, unique_ptr<Edge>, coord_hash> EdgeMap;
+typedef tsl::robin_map<uint32_t, unique_ptr<Node, NodeDeleter>, int_hash> NodeMap;
+typedef tsl::robin_map<Coords, unique_ptr<Edge, EdgeDeleter>, coord_hash> EdgeMap;
 
 /* TMP + Perfect Forwarding for C++11 // built into C++14 */
 template<typename T, typename... Args>
@@ -197,6 +284,335 @@ public:
 bool operator==(const PropertyPack &lhs, const PropertyPack &rhs);
 bool operator!=(const PropertyPack &lhs, const PropertyPack &rhs);
 
+/**
+ * A network stores the values of its nodes (and of its edges) by column: column i
+ * holds value i of every node, and each node has a dense slot in the columns.  Each
+ * column is split into chunks of chunk_size slots.  Chunks are shared by copies of a
+ * network, and a chunk is cloned the first time one of the sharers writes to it
+ * (copy-on-write), so changing a few values of a copy only clones the chunks that
+ * hold them.
+ */
+class ValueStore
+{
+public:
+    typedef vector <double> Chunk;
+    typedef vector < std::shared_ptr <Chunk> > Column;
+
+    static const size_t chunk_bits = 10;
+    static const size_t chunk_size = (size_t) 1 << chunk_bits;   /**< Slots in a chunk */
+
+    vector <Column> columns;   /**< columns[value index][slot / chunk_size][slot % chunk_size] */
+
+    const double& read(size_t i, uint32_t slot) const
+    {
+        return (*columns[i][slot >> chunk_bits])[slot & (chunk_size - 1)];
+    }
+
+    double& write(size_t i, uint32_t slot)
+    {
+        return (*own(i, slot >> chunk_bits))[slot & (chunk_size - 1)];
+    }
+
+    Chunk *own(size_t i, size_t c)   /**< Chunk c of column i, cloned first if it's shared */
+    {
+        std::shared_ptr <Chunk> &p = columns[i][c];
+
+        if (p.use_count() != 1) p = std::make_shared <Chunk>(*p);
+        return p.get();
+    }
+
+    Column *own_column(size_t i)     /**< Column i, with every chunk cloned if it's shared */
+    {
+        size_t c;
+
+        for (c = 0; c < columns[i].size(); c++) own(i, c);
+        return &columns[i];
+    }
+};
+
+class ValueRow;
+
+/**
+ * What indexing a non-const ValueRow returns.  It reads the row when it's read, and
+ * only writes (and so clones a shared chunk) when it's assigned to.
+ */
+class ValueRef
+{
+public:
+    ValueRef(ValueRow *r, size_t i) : row(r), index(i) {}
+
+    operator double() const;
+    ValueRef& operator=(double d);
+    ValueRef& operator=(const ValueRef &r) { return *this = (double) r; }
+    ValueRef& operator+=(double d) { return *this = (double) *this + d; }
+    ValueRef& operator-=(double d) { return *this = (double) *this - d; }
+    ValueRef& operator*=(double d) { return *this = (double) *this * d; }
+    ValueRef& operator/=(double d) { return *this = (double) *this / d; }
+
+protected:
+    ValueRow *row;
+    size_t index;
+};
+
+/**
+ * An iterator over a ValueRow.  Row is ValueRow or const ValueRow, and Ref is ValueRef
+ * or const double&.
+ */
+template <class Row, class Ref>
+class ValueRowIterator
+{
+public:
+    typedef std::random_access_iterator_tag iterator_category;
+    typedef double value_type;
+    typedef std::ptrdiff_t difference_type;
+    typedef void pointer;
+    typedef Ref reference;
+
+    ValueRowIterator(Row *r = nullptr, size_t i = 0) : row(r), index(i) {}
+
+    Ref operator*() const { return (*row)[index]; }
+    Ref operator[](difference_type n) const { return (*row)[index + n]; }
+
+    ValueRowIterator& operator++() { index++; return *this; }
+    ValueRowIterator& operator--() { index--; return *this; }
+    ValueRowIterator operator++(int) { ValueRowIterator rv = *this; index++; return rv; }
+    ValueRowIterator operator--(int) { ValueRowIterator rv = *this; index--; return rv; }
+    ValueRowIterator& operator+=(difference_type n) { index += n; return *this; }
+    ValueRowIterator& operator-=(difference_type n) { index -= n; return *this; }
+    ValueRowIterator operator+(difference_type n) const { return ValueRowIterator(row, index + n); }
+    ValueRowIterator operator-(difference_type n) const { return ValueRowIterator(row, index - n); }
+    difference_type operator-(const ValueRowIterator &it) const { return (difference_type) index - (difference_type) it.index; }
+
+    bool operator==(const ValueRowIterator &it) const { return index == it.index; }
+    bool operator!=(const ValueRowIterator &it) const { return index != it.index; }
+    bool operator<(const ValueRowIterator &it) const { return index < it.index; }
+    bool operator>(const ValueRowIterator &it) const { return index > it.index; }
+    bool operator<=(const ValueRowIterator &it) const { return index <= it.index; }
+    bool operator>=(const ValueRowIterator &it) const { return index >= it.index; }
+
+protected:
+    Row *row;
+    size_t index;
+};
+
+/**
+ * A ValueRow is a node's or edge's view of its slot in the columns, and it works
+ * like the vector<double> that `values` used to be.  Assigning to it copies values
+ * into the columns, so the sizes have to match the PropertyPack.  Only writes clone
+ * shared chunks: `values[i]` on a non-const row is a ValueRef, which writes only when
+ * it's assigned to, and write(i) is for a double&.  A copy of a ValueRow (for example,
+ * `auto v = n->values`) is detached: it holds its own values, like a copy of a
+ * vector would, and changing it doesn't change the node.
+ */
+class ValueRow
+{
+public:
+    typedef ValueRowIterator <ValueRow, ValueRef> iterator;
+    typedef ValueRowIterator <const ValueRow, const double&> const_iterator;
+
+    ValueRow() = default;
+    ValueRow(const ValueRow &r) : detached(new vector<double>(r.to_vector())) {}
+    ValueRow& operator=(const ValueRow &r);          /**< Copy the values of another row */
+    ValueRow& operator=(const vector<double> &v);    /**< Copy the values of a vector */
+
+    size_t size() const
+    {
+      if (store != nullptr) return store->columns.size();
+      return (detached == nullptr) ? 0 : detached->size();
+    }
+    bool empty() const { return size() == 0; }
+
+    ValueRef operator[](size_t i) { return ValueRef(this, i); }
+    const double& operator[](size_t i) const { return (store != nullptr) ? store->read(i, slot) : (*detached)[i]; }
+    ValueRef at(size_t i);                           /**< Throws std::out_of_range */
+    const double& at(size_t i) const;
+
+    double& write(size_t i)                          /**< Value i, to write it */
+      { return (store != nullptr) ? store->write(i, slot) : (*detached)[i]; }
+
+    iterator begin() { return iterator(this, 0); }
+    iterator end() { return iterator(this, size()); }
+    const_iterator begin() const { return const_iterator(this, 0); }
+    const_iterator end() const { return const_iterator(this, size()); }
+    const_iterator cbegin() const { return begin(); }
+    const_iterator cend() const { return end(); }
+
+    vector<double> to_vector() const;
+    operator vector<double>() const { return to_vector(); }
+
+    ValueStore *store = nullptr;      /**< The network's columns */
+    uint32_t slot = 0;                /**< Our index in each column */
+
+protected:
+    std::unique_ptr < vector <double> > detached;   /**< A copy's values */
+};
+
+inline ValueRef::operator double() const { return ((const ValueRow *) row)->operator[](index); }
+inline ValueRef& ValueRef::operator=(double d) { row->write(index) = d; return *this; }
+
+bool operator==(const ValueRow &lhs, const ValueRow &rhs);
+bool operator!=(const ValueRow &lhs, const ValueRow &rhs);
+bool operator==(const ValueRow &lhs, const vector<double> &rhs);
+bool operator!=(const ValueRow &lhs, const vector<double> &rhs);
+void to_json(json &j, const ValueRow &r);
+
+/**
+ * One column, from Network::node_column() or Network::edge_column().  Entry i
+ * belongs to Network::column_node(i) (or column_edge(i)).  Its iterators walk the
+ * column a chunk at a time.  Adding or removing nodes or edges, or copying the
+ * network, invalidates it.
+ */
+class ValueSpan
+{
+public:
+    class iterator
+    {
+    public:
+        typedef std::forward_iterator_tag iterator_category;
+        typedef double value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef double* pointer;
+        typedef double& reference;
+
+        iterator(const ValueStore::Column *c = nullptr, size_t s = 0, size_t n = 0)
+          : column(c), slot(s), count(n), ptr(nullptr), chunk_end(nullptr)
+        {
+            if (slot < count) point();
+        }
+
+        double& operator*() const { return *ptr; }
+        double* operator->() const { return ptr; }
+        iterator& operator++()
+        {
+            slot++;
+            if (++ptr == chunk_end && slot < count) point();
+            return *this;
+        }
+        iterator operator++(int) { iterator rv = *this; ++(*this); return rv; }
+        bool operator==(const iterator &it) const { return slot == it.slot; }
+        bool operator!=(const iterator &it) const { return slot != it.slot; }
+
+    protected:
+        void point()
+        {
+            ValueStore::Chunk &c = *(*column)[slot >> ValueStore::chunk_bits];
+
+            ptr = c.data() + (slot & (ValueStore::chunk_size - 1));
+            chunk_end = c.data() + c.size();
+        }
+
+        const ValueStore::Column *column;
+        size_t slot;
+        size_t count;
+        double *ptr;
+        double *chunk_end;
+    };
+
+    ValueSpan(ValueStore::Column *c = nullptr, size_t n = 0) : column(c), count(n) {}
+
+    size_t size() const { return count; }
+    iterator begin() const { return iterator(column, 0, count); }
+    iterator end() const { return iterator(column, count, count); }
+    double& operator[](size_t i) const
+    {
+        return (*(*column)[i >> ValueStore::chunk_bits])[i & (ValueStore::chunk_size - 1)];
+    }
+
+protected:
+    ValueStore::Column *column;
+    size_t count;
+};
+
+/**
+ * The columns and the elements that own their slots.  T is Node or Edge.  When an
+ * element is removed, the last slot moves into its place, so that the columns
+ * stay dense.
+ */
+template <class T>
+class ValueColumns : public ValueStore
+{
+public:
+    vector <T *> owners;                  /**< The element in each slot */
+
+    void add(T *t, size_t vec_size)       /**< Give t a slot, with zeros for its values */
+    {
+        size_t i, slot;
+
+        if (owners.empty() && columns.size() != vec_size) reshape(vec_size);
+        slot = owners.size();
+        t->values.store = this;
+        t->values.slot = slot;
+        owners.push_back(t);
+        for (i = 0; i < columns.size(); i++) {
+          if ((slot & (chunk_size - 1)) == 0) columns[i].push_back(std::make_shared <Chunk>());
+          own(i, slot >> chunk_bits)->push_back(0);
+        }
+    }
+
+    void remove(T *t)                     /**< Give back t's slot */
+    {
+        size_t i, last;
+        uint32_t slot;
+        double d;
+
+        slot = t->values.slot;
+        t->values.store = nullptr;
+        if (slot >= owners.size() || owners[slot] != t) return;   /* After clear() */
+        last = owners.size() - 1;
+        for (i = 0; i < columns.size(); i++) {
+          if (slot != last) {
+            d = read(i, last);
+            write(i, slot) = d;
+          }
+          if ((last & (chunk_size - 1)) == 0) {
+            columns[i].pop_back();
+          } else {
+            own(i, last >> chunk_bits)->pop_back();
+          }
+        }
+        owners[slot] = owners[last];
+        owners[slot]->values.slot = slot;
+        owners.pop_back();
+    }
+
+    void reshape(size_t vec_size)         /**< Set the number of columns, zeroing every value */
+    {
+        size_t i, start, n;
+
+        columns.assign(vec_size, Column());
+        for (i = 0; i < vec_size; i++) {
+          for (start = 0; start < owners.size(); start += chunk_size) {
+            n = owners.size() - start;
+            if (n > chunk_size) n = chunk_size;
+            columns[i].push_back(std::make_shared <Chunk>(n, 0));
+          }
+        }
+    }
+
+    void adopt(T *t)                      /**< Give t the next slot, whose values come with the columns */
+    {
+        t->values.store = this;
+        t->values.slot = owners.size();
+        owners.push_back(t);
+    }
+
+    void reserve(size_t n)
+    {
+        size_t i;
+
+        owners.reserve(owners.size() + n);
+        for (i = 0; i < columns.size(); i++) {
+          columns[i].reserve((owners.size() + n + chunk_size - 1) >> chunk_bits);
+        }
+    }
+
+    void clear()
+    {
+        columns.clear();
+        owners.clear();
+    }
+};
+
 /**
  * The Node class represents a single node in a graph/network. 
  * Typically, for our use, this means it serves as a neuron.
@@ -209,7 +625,7 @@ public:
 
     /* Constructors, assignment overleads, etc. */
 
-    Node(uint32_t idx, Network* n = nullptr) : id(idx), net(n) {};
+    Node(uint32_t idx, NetworkTopology* t = nullptr) : id(idx), topology(t) {};
     Node(const Node &n) = delete;
     Node(Node &&n) = delete;
     Node& operator=(const Node &n) = delete;
@@ -221,19 +637,25 @@ public:
     uint32_t id = 0;                /**< Node ID */
     int input_id = -1;              /**< If it's an input node, the input id number. */
     int output_id = -1;             /**< If it's an output node, the output id number. */
-    const Network *net;             /**< Pointer to the network that contains the node. */
-    vector<double> values;          /**< Values defined by the PropertyPack */
+    const NetworkTopology *topology; /**< What holds the node, shared by copies of its network. */
+    ValueRow values;                /**< Values defined by the PropertyPack */
     vector<Edge*> incoming;         /**< Incoming edges */
     vector<Edge*> outgoing;         /**< Outgoing edges */
-    vector <double> coordinates;    /**< Optional -- useful if you are writing or using a visualization */
-    string name;                    /**< Optional -- can be useful for viz's or hand-tooling networks */
 
     /* Getting / Setting values */
 
     void set(int idx, double val);              /**< Set a value by its index in values */
     void set(const string& name, double val);   /**< Set a value by its name in the PropertyPack */
-    double get(int idx);                        /**< Get a value by index. */
-    double get(const string& name);             /**< Get a value by name. */
+    double get(int idx) const;                  /**< Get a value by index. */
+    double get(const string& name) const;       /**< Get a value by name. */
+
+    /* The optional name and coordinates, for viz's and hand-tooling.  The network
+       keeps them in side tables, so nodes that don't have them don't pay for them. */
+
+    const string& get_name() const;                       /**< "" if there's no name */
+    void set_name(const string& name);                    /**< "" removes the name */
+    const vector<double>& get_coordinates() const;        /**< Empty if there are none */
+    void set_coordinates(const vector<double>& coords);   /**< Empty removes them */
 
     /* Hidden / Input / Output */
 
@@ -259,7 +681,7 @@ public:
 
     /* Constructors, assignment overleads, etc. */
 
-    Edge(Node *f, Node *t, Network *n = nullptr) : from(f), to(t), net(n) {}
+    Edge(Node *f, Node *t, NetworkTopology *n = nullptr) : from(f), to(t), topology(n) {}
     Edge(const Edge &e) = delete;
     Edge(Edge &&e) = delete;
     Edge& operator=(const Edge &n) = delete;
@@ -270,17 +692,69 @@ public:
 
     Node* from;                         /**< The node that the edge is coming from. */
     Node* to;                           /**< The node that the edge is going to. */
-    const Network *net;                 /**< Pointer to the network that contains the node. */
-    vector<double> values;              /**< Values defined by the PropertyPack */
+    const NetworkTopology *topology;    /**< What holds the edge, shared by copies of its network. */
+    ValueRow values;                    /**< Values defined by the PropertyPack */
     json as_json() const;               /**< Turn it into a json object */
-    vector <double> control_point;      /**< Optional. Bezier control point(s) for displaying. */
+    uint32_t out_index = 0;             /**< Position in from->outgoing.  Kept up by the Network. */
+    uint32_t in_index = 0;              /**< Position in to->incoming.  Kept up by the Network. */
 
     /* Getting / Setting values */
 
     void set(int idx, double val);              /**< Set a value by its index in values */
     void set(const string& name, double val);   /**< Set a value by its name in the PropertyPack */
-    double get(int idx);                        /**< Get a value by index. */
-    double get(const string& name);             /**< Get a value by name. */
+    double get(int idx) const;                  /**< Get a value by index. */
+    double get(const string& name) const;       /**< Get a value by name. */
+
+    /* The optional Bezier control point(s) for displaying, kept by the network like
+       the node names and coordinates. */
+
+    const vector<double>& get_control_point() const;      /**< Empty if there are none */
+    void set_control_point(const vector<double>& cp);     /**< Empty removes them */
+};
+
+/**
+ * The nodes and edges of a network, with everything that holds them or refers to them:
+ * the PropertyPack, the slabs, the value columns, the side tables and the hash tables.
+ * Copies of a network share one, and a network clones its topology before its first
+ * change when it's shared (copy-on-write), so copying a network doesn't copy its nodes
+ * and edges.  The Network class is the way to use it.
+ */
+class NetworkTopology
+{
+public:
+    NetworkTopology() = default;
+    NetworkTopology(const NetworkTopology &t) = delete;
+    NetworkTopology& operator=(const NetworkTopology &t) = delete;
+    ~NetworkTopology() noexcept;
+
+    std::shared_ptr <NetworkTopology> clone() const;   /**< A copy with new nodes and edges */
+    void clear();                                      /**< Everything but the PropertyPack */
+    void clear_side_tables();                          /**< Empty the names, coordinates and control points */
+
+    PropertyPack properties;
+
+    /* Storage for the nodes and edges.  These are declared before the maps, so that
+       they outlive them. */
+
+    Arena <Node> node_arena;
+    Arena <Edge> edge_arena;
+
+    /* The node and edge values, by column.  These outlive the maps as well. */
+
+    ValueColumns <Node> node_values;
+    ValueColumns <Edge> edge_values;
+
+    /* Node names and coordinates, and edge control points, for only the nodes and
+       edges that have them.  These outlive the maps too. */
+
+    std::unordered_map <const Node *, string> node_names;
+    std::unordered_map <const Node *, vector <double> > node_coords;
+    std::unordered_map <const Edge *, vector <double> > control_points;
+
+    /* The nodes and edges, keyed by node id and by (from, to). */
+
+    NodeMap nodes;
+    EdgeMap edges;
 };
 
 /**
@@ -296,7 +770,7 @@ public:
 
     /* Constructors, assignment overloads, etc. */
 
-    Network() = default;
+    Network();
     Network(const Network &net);
     Network(Network &&net);
     Network& operator=(const Network &net);
@@ -305,6 +779,19 @@ public:
 
     bool operator==(const Network &rhs) const;
 
+    /* A 64-bit hash of the PropertyPack, values, nodes, edges, inputs and outputs, which
+       doesn't depend on the order that they were added.  Names, coordinates, control
+       points and associated data only count if include_metadata is true. */
+
+    uint64_t content_hash(bool include_metadata = false) const;
+
+    /* The number of chunks in the node and edge value columns, and the number of them
+       that are shared with net, which is a copy.  These are for checking copy-on-write. */
+
+    size_t value_chunks() const;
+    size_t shared_value_chunks(const Network &net) const;
+    bool shares_topology(const Network &net) const;  /**< Are our nodes and edges net's too? */
+
     void clear(bool include_properties); /**< Clear network, optionally clear properties. */
 
     /* JSON methods */
@@ -312,7 +799,18 @@ public:
     void to_json(json &j) const;       /**< Add keys/vals to existing json */
     json as_json() const;              /**< Return json representation */
     void from_json(const json &j);     /**< Create from json */
+    void from_json_stream(std::istream &in);      /**< Create from json text, streaming the nodes and edges */
+    void from_json_file(const string &filename);  /**< from_json_stream() on a file */
+
+    /* Binary methods -- see markdown/network.md for the file format. */
+
+    void save_binary(std::ostream &out) const;    /**< Write the binary format */
+    void save_binary(const string &filename) const;
+    void load_binary(std::istream &in);           /**< Create from the binary format */
+    void load_binary(const string &filename);     /**< load_binary() on a memory-mapped file */
+    static bool is_binary_file(const string &filename); /**< Does the file start with the binary magic? */
 
+    void write_json(std::ostream &out, bool pretty = false) const; /**< Stream the json, without making it */
     string pretty_json() const;        /**< Create a json string that's better than dump(). */
     string pretty_nodes() const;       /**< Create a nice json string of the nodes. */
     string pretty_edges() const;       /**< Create a nice json string of the edges. */
@@ -329,30 +827,46 @@ public:
     const Property* get_node_property(const string& name) const;    /**< Get the node property. */
     const Property* get_edge_property(const string& name) const;    /**< Get the edge property. */
     const Property* get_network_property(const string& name) const; /**< Get the network property. */
+
+    /* Columnar access to the node and edge values.  k selects the value of a property
+       whose size is more than one. */
+
+    ValueSpan node_column(const string& name, int k = 0);  /**< Every node's value of the property */
+    ValueSpan edge_column(const string& name, int k = 0);  /**< Every edge's value of the property */
+    Node* column_node(size_t slot);                        /**< The node in a column's slot */
+    Edge* column_edge(size_t slot);                        /**< The edge in a column's slot */
+    const Node* column_node(size_t slot) const;
+    const Edge* column_edge(size_t slot) const;
  
-    /* Adding / modifying / deleting nodes and edges */
+    /* Adding / modifying / deleting nodes and edges.  The non-const methods that return
+       nodes or edges give the network its own topology first, if it's shared with a copy;
+       the const ones don't, and they return const pointers. */
 
     Node* add_node(uint32_t idx);                        /**< Create node with id */
     bool is_node(uint32_t idx) const;                    /**< Does node with id exist? */
-    Node* get_node(uint32_t idx) const;                  /**< Return node with id */
+    Node* get_node(uint32_t idx);                        /**< Return node with id */
+    const Node* get_node(uint32_t idx) const;
     Node* add_or_get_node(uint32_t idx);                 /**< Return node with id , or create it */
     void remove_node(uint32_t idx, bool force = false);  /**< Delete node - if force=false, error on IO nodes. */
     void rename_node(uint32_t old_name, uint32_t new_name); /**< Change node's id */
 
     Edge* add_edge(uint32_t fr, uint32_t to);            /**< Analogous to add_node() */
     bool is_edge(uint32_t fr, uint32_t to) const;        /**< Analogous to is_node() */
-    Edge* get_edge(uint32_t fr, uint32_t to) const;      /**< Analogous to get_node() */
+    Edge* get_edge(uint32_t fr, uint32_t to);            /**< Analogous to get_node() */
+    const Edge* get_edge(uint32_t fr, uint32_t to) const;
     Edge* add_or_get_edge(uint32_t fr, uint32_t to);     /**< Analogous to add_or_get_node() */
     void remove_edge(uint32_t fr, uint32_t to);          /**< Analogous to remove_node() */
 
     /* Input and output nodes */
 
     int add_input(uint32_t idx);                    /**< Add the next input */
-    Node* get_input(int input_id) const;            /**< Return a pointer to the given input */
+    Node* get_input(int input_id);                  /**< Return a pointer to the given input */
+    const Node* get_input(int input_id) const;
     int num_inputs() const;                         /**< The number of input nodes */
 
     int add_output(uint32_t idx);                    /**< Add the next output */
-    Node* get_output(int output_id) const;           /**< Return a pointer to the given output */
+    Node* get_output(int output_id);                 /**< Return a pointer to the given output */
+    const Node* get_output(int output_id) const;
     int num_outputs() const;                         /**< The number of output nodes */
 
     /* The Associated Data JSON */
@@ -363,10 +877,14 @@ public:
 
     /* Methods to help do randomization */
 
-    Node* get_random_node(MOA &moa) const;        /**< Get a random node */
-    Edge* get_random_edge(MOA &moa) const;        /**< Get a random edge */
-    Node* get_random_input(MOA &moa) const;       /**< Get a random input node */
-    Node* get_random_output(MOA &moa) const;      /**< Get a random output node */
+    Node* get_random_node(MOA &moa);              /**< Get a random node */
+    Edge* get_random_edge(MOA &moa);              /**< Get a random edge */
+    Node* get_random_input(MOA &moa);             /**< Get a random input node */
+    Node* get_random_output(MOA &moa);            /**< Get a random output node */
+    const Node* get_random_node(MOA &moa) const;
+    const Edge* get_random_edge(MOA &moa) const;
+    const Node* get_random_input(MOA &moa) const;
+    const Node* get_random_output(MOA &moa) const;
     
     void randomize_properties(MOA &moa);          /**< Randomize network values */
     void randomize_properties(MOA &moa, Node *n); /**< Randomize node values */
@@ -380,21 +898,35 @@ public:
                             const Property& p,  
                             vector<double>& values); 
 
-    void randomize(const json& params);            /**< Generate a random network (unimplemented) */
+    void randomize_property(MOA& moa,                /**< Randomize a single value in the row. */
+                            const Property& p,
+                            ValueRow& values);
+
+    /* Replace the nodes and edges with a random network, keeping the PropertyPack and
+       the associated data.  The params are described in markdown/network.md.  The first
+       version seeds its own RNG with params["seed"]. */
+
+    void randomize(const json& params);
+    void randomize(MOA &moa, const json& params);
 
     /* Pruning and Sorting */
 
     void prune();                      /**< Prune nodes and edges not on an I/O path */
     void make_sorted_node_vector();       /**< Sort the nodes by id, nothing if already sorted. */
-    vector <Node *> sorted_node_vector;   /**< The sorted nodes */
+    vector <Node *> sorted_node_vector;   /**< The sorted nodes.  Empty after any mutation. */
 
-    /* Iterators and Metadata */
+    /* Iterators and Metadata.  As with get_node(), the non-const iterators give the
+       network its own topology first. */
 
     NodeMap::iterator begin();         /**< Beginning of the nodes in the node hash table. */
     NodeMap::iterator end();           /**< End of the nodes in the node hash table. */
+    NodeMap::const_iterator begin() const;
+    NodeMap::const_iterator end() const;
 
     EdgeMap::iterator edges_begin();       /**< Beginning of the edges in the edge hash table. */
     EdgeMap::iterator edges_end();         /**< End of the edges in the edge hash table. */
+    EdgeMap::const_iterator edges_begin() const;
+    EdgeMap::const_iterator edges_end() const;
     
     size_t num_nodes() const;          /**< Number of nodes. */
     size_t num_edges() const;          /**< Number of edges. */
@@ -412,27 +944,128 @@ protected:
     double random_value(MOA &moa, const Property &p);
 
     /* random network -- edges with probability p */
-    void randomize_p(const json& params);
+    void randomize_p(MOA &moa, const json& params);
 
     /* random network -- input -> hidden -> output */
-    void randomize_h(const json& params);
+    void randomize_h(MOA &moa, const json& params);
+
+    /* random network -- a ring where each node connects to its neighbors, rewired */
+    void randomize_w(MOA &moa, const json& params);
+
+    /* pieces of the random networks: the nodes, and then the edges */
+    void random_nodes(MOA &moa, const json& params);
+    void random_edges(MOA &moa, const vector < pair <uint32_t, uint32_t> > &edges);
+
+    /* pieces of from_json() and from_json_stream() */
+    void network_values_from_json(const json &j);
+    Node *node_from_json(const json &jn);
+    Edge *edge_from_json(const json &je);
+    void check_values(const Node *n, size_t size) const;
+    void check_values(const Edge *e, size_t size) const;
+    void io_from_json(const json &j);
+
+    /* pieces of write_json(), pretty_nodes() and pretty_edges() */
+    void write_nodes(std::ostream &out, const string &indent) const;
+    void write_edges(std::ostream &out, const string &indent) const;
+
+    /* load_binary() on a buffer holding the whole file */
+    void from_binary(const char *data, size_t size);
+
+    /* the topology, cloned first if it's shared with a copy */
+    NetworkTopology &own();
+
+    /* maintenance of the sorted node index behind make_sorted_node_vector() */
+    void touch_sorted_index(uint32_t id);
+    void clear_sorted_index();
 
     /* inputs/outputs -- index = input/output id, value = node id */
     vector<uint32_t> m_inputs;
     vector<uint32_t> m_outputs;
 
-    /* Nodes and Edges for the network stored centrally */
-
-    NodeMap m_nodes;
-    EdgeMap m_edges;
+    /* The PropertyPack, nodes and edges, which copies share until they change them.
+       It's never null. */
 
-    PropertyPack m_properties;
+    std::shared_ptr <NetworkTopology> m_topology;
 
     /* dictionary of associated data (e.g. encoder params, app params, etc.) */
     json m_associated_data = {};
 
-    friend class Node;
-    friend class Edge;
+    /* The sorted node index.  When a mutation empties sorted_node_vector, its
+       contents move to m_sorted_base, and the ids of the nodes that were added,
+       removed or renamed go on m_sorted_pending.  make_sorted_node_vector() then
+       merges the two, rather than sorting the whole network again.  m_sorted_ids
+       holds the ids of m_sorted_base, since its removed nodes may be gone. */
+
+    vector <Node *> m_sorted_base;
+    vector <uint32_t> m_sorted_ids;
+    vector <uint32_t> m_sorted_pending;
+    bool m_sorted_valid = false;
+};
+
+/**
+ * A NetworkGraph is a snapshot of a network's topology, for graph queries: reachability,
+ * cycles, depth, path delays and fan-in/fan-out.  Node i of the graph is the network's
+ * sorted_node_vector[i].  Everything is iterative, so long chains can't overflow the
+ * stack.  Please see `markdown/network_analysis.md` for documentation.
+ */
+
+class NetworkGraph
+{
+public:
+    NetworkGraph(Network *net, const string &delay_property = "Delay");
+
+    size_t size() const;                          /**< Number of nodes */
+    int index(uint32_t node_id) const;            /**< The node's index, or -1 */
+    vector <Node *> nodes;                        /**< The nodes, sorted by id */
+
+    /* Reachability.  Entry i is for nodes[i]. */
+
+    vector <bool> from_inputs() const;            /**< Is there a path from an input? */
+    vector <bool> to_outputs() const;             /**< Is there a path to an output? */
+
+    /* Cycles and depth */
+
+    vector < vector <uint32_t> > components() const; /**< SCCs as node ids, topologically sorted */
+    bool is_feed_forward() const;                 /**< No cycles, including self-loops */
+    vector <int> depths() const;                  /**< Depth of each node's SCC */
+
+    /* Total delays of paths from the inputs.  -1 means there's no path, and a longest
+       delay is infinity when there's a cycle on the way. */
+
+    vector <double> shortest_delays() const;
+    vector <double> longest_delays() const;
+    double shortest_io_delay() const;             /**< Over all outputs, -1 if none is reachable */
+    double longest_io_delay() const;              /**< Over all outputs, -1 if none is reachable */
+
+    /* Entry k is the number of nodes with k incoming/outgoing edges. */
+
+    vector <size_t> fan_in_histogram() const;
+    vector <size_t> fan_out_histogram() const;
+
+protected:
+    void find_components();
+
+    tsl::robin_map <uint32_t, uint32_t> m_index;  /* Node id to index */
+    vector <uint32_t> m_inputs;                   /* Indices of the input and output nodes */
+    vector <uint32_t> m_outputs;
+
+    /* Adjacency lists in CSR form: node i's outgoing edges are m_out[m_out_start[i]] to
+       m_out[m_out_start[i+1]-1], with delays in m_out_delay.  Likewise incoming. */
+
+    vector <uint32_t> m_out_start;
+    vector <uint32_t> m_out;
+    vector <double> m_out_delay;
+    vector <uint32_t> m_in_start;
+    vector <uint32_t> m_in;
+    vector <double> m_in_delay;
+
+    /* SCCs, numbered in topological order.  m_order holds the node indices grouped by
+       component, and component c is m_order[m_comp_start[c]] to m_order[m_comp_start[c+1]-1]. */
+
+    vector <uint32_t> m_comp;
+    vector <uint32_t> m_comp_start;
+    vector <uint32_t> m_order;
+    vector <bool> m_cyclic;
 };
 
 /**
@@ -599,6 +1232,93 @@ Network *pull_network(Processor *p, Network *n, int network_id = 0);
 
 void apply_spike_raster(Processor *p, int in_neuron, const vector <char> &sr, int network_id = 0);
 
+/**
+ * A NetworkBatchLoader reads many network files at once, on a pool of threads.  Each
+ * file may be JSON or the binary format.  Please see "Loading Many Networks" in
+ * `markdown/network.md` for documentation.
+ */
+
+class NetworkBatchLoader
+{
+public:
+    NetworkBatchLoader(int max_threads = 0, size_t max_bytes = 0);
+
+    /* Returns new networks, in the order of the files.  If a file fails, the networks
+       are deleted, and this throws the first failure, with the file's name. */
+
+    vector <Network *> load(const vector <string> &filenames) const;
+
+    /* load(), and then p->load_networks() on the networks.  The networks are yours to
+       delete; the processor doesn't keep them. */
+
+    vector <Network *> load_networks(Processor *p, const vector <string> &filenames) const;
+
+    int max_threads;       /**< Threads to use.  0 means one per core. */
+    size_t max_bytes;      /**< Cap on the file bytes being parsed at once.  0 means no cap. */
+};
+
+/**
+ * A least-recently-used cache from Network::content_hash() values to whatever a
+ * processor compiles a network into.  Processors keep one, so that loading a network
+ * that they have already seen skips the compilation.  The values are shared_ptrs, so
+ * an evicted value lives on in the processor networks that still use it.  A capacity
+ * of zero turns the cache off.
+ */
+
+template <class T>
+class NetworkCache
+{
+public:
+    NetworkCache(size_t capacity = 0) : m_capacity(capacity) {}
+
+    std::shared_ptr <T> get(uint64_t key)     /**< nullptr if it's not there */
+    {
+        typename Index::iterator it;
+
+        it = m_index.find(key);
+        if (it == m_index.end()) return nullptr;
+        m_lru.splice(m_lru.begin(), m_lru, it->second);
+        return it->second->second;
+    }
+
+    void put(uint64_t key, std::shared_ptr <T> value)
+    {
+        typename Index::iterator it;
+
+        if (m_capacity == 0) return;
+        it = m_index.find(key);
+        if (it != m_index.end()) {
+            it->second->second = value;
+            m_lru.splice(m_lru.begin(), m_lru, it->second);
+            return;
+        }
+        m_lru.push_front(std::make_pair(key, value));
+        m_index[key] = m_lru.begin();
+        evict();
+    }
+
+    void clear() { m_lru.clear(); m_index.clear(); }
+    size_t size() const { return m_lru.size(); }
+    size_t capacity() const { return m_capacity; }
+    void set_capacity(size_t capacity) { m_capacity = capacity; evict(); }
+
+protected:
+    typedef std::list < pair <uint64_t, std::shared_ptr <T> > > List;
+    typedef std::unordered_map <uint64_t, typename List::iterator> Index;
+
+    void evict()
+    {
+        while (m_lru.size() > m_capacity) {
+            m_index.erase(m_lru.back().first);
+            m_lru.pop_back();
+        }
+    }
+
+    size_t m_capacity;
+    List m_lru;            /**< Most recently used first */
+    Index m_index;
+};
+
 
 }   // End of neuro namespace.
 
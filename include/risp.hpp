@@ -60,6 +60,9 @@ public:
           vector <double> & _stds);  
   ~Network();
 
+  /** A new network with the same neurons, synapses and settings, and no activity. */
+  Network* clone() const;
+
   /* Similar calls from Processor API */
   void apply_spike(const Spike& s, bool normalized = true);
   void run(double duration);
@@ -230,6 +233,10 @@ protected:
   uint32_t noisy_seed;
   vector <double> weights;
   vector <double> stds;
+  size_t network_cache;     /**< Capacity of template_cache */
+
+  /* Networks that have never run, by content_hash().  See markdown/risp.md. */
+  NetworkCache <risp::Network> template_cache;
 
   uint32_t min_delay;
   uint32_t max_delay;
@@ -0,0 +1,89 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <fstream>
+#include <iostream>
+
+/* Files whose names end in ".gz" are read and written with zlib, a buffer at a time,
+   so a big network or command file is never decompressed whole.  Every other file
+   is a plain file.  InputFile and OutputFile work like ifstream and ofstream, so
+   they can be dropped in wherever those are used.  Opening a ".zst" file fails with
+   errno set to ENOTSUP, since we don't link with zstd.  Reading a corrupt or truncated
+   .gz file throws a runtime_error, which an istream turns into badbit.  The code is in
+   src/file_helpers.cpp, and it needs -lz. */
+
+struct gzFile_s;
+
+namespace neuro
+{
+
+bool file_is_compressed(const std::string &filename);   /**< Does the name end in .gz? */
+
+/** A streambuf on a gzip file. */
+
+class GzStreamBuf : public std::streambuf
+{
+public:
+    GzStreamBuf() = default;
+    GzStreamBuf(const GzStreamBuf &) = delete;
+    GzStreamBuf& operator=(const GzStreamBuf &) = delete;
+    ~GzStreamBuf();
+
+    bool open(const std::string &filename, bool write);   /**< False if it can't */
+    bool dopen(int fd);                                    /**< Read from a file descriptor */
+    bool close();                                          /**< False if a write failed */
+    bool is_open() const { return m_gz != nullptr; }
+
+protected:
+    int_type underflow() override;
+    int_type overflow(int_type c) override;
+    int sync() override;
+    bool flush_buffer();
+
+    gzFile_s *m_gz = nullptr;
+    bool m_write = false;
+    std::vector <char> m_buf;
+};
+
+/** An ifstream that decompresses .gz files. */
+
+class InputFile : public std::istream
+{
+public:
+    InputFile() : std::istream(nullptr) {}
+    explicit InputFile(const std::string &filename) : std::istream(nullptr) { open(filename); }
+
+    void open(const std::string &filename);   /**< Sets failbit if it can't */
+    void close();
+    bool is_open() const { return m_file.is_open() || m_gz.is_open(); }
+
+protected:
+    std::filebuf m_file;
+    GzStreamBuf m_gz;
+};
+
+/** An ofstream that compresses .gz files. */
+
+class OutputFile : public std::ostream
+{
+public:
+    OutputFile() : std::ostream(nullptr) {}
+    explicit OutputFile(const std::string &filename) : std::ostream(nullptr) { open(filename); }
+    ~OutputFile() { close(); }
+
+    void open(const std::string &filename);   /**< Sets failbit if it can't */
+    void close();                             /**< Sets failbit if the last writes fail */
+    bool is_open() const { return m_file.is_open() || m_gz.is_open(); }
+
+protected:
+    std::filebuf m_file;
+    GzStreamBuf m_gz;
+};
+
+/* If standard input is redirected from a gzip-compressed file, this makes cin read
+   it decompressed.  Pipes and terminals are left alone, since zlib waits for a full
+   buffer before it returns anything. */
+
+void cin_from_compressed_file();
+
+}   // End of neuro namespace.
@@ -5,6 +5,7 @@
 #include <fstream>
 #include <iostream>
 #include "nlohmann/json.hpp"
+#include "file_helpers.hpp"
 
 #define JSON_MAX_LONG_LONG (0x1000000000000LL)
 
@@ -186,7 +187,7 @@ inline static std::string Parameter_Check (const nlohmann::json &p,
 inline static nlohmann::json json_from_string_or_file(const std::string &s)
 {
   nlohmann::json j;
-  std::ifstream f;
+  InputFile f;
   bool fopen;
   std::string es;
   
@@ -11,20 +11,70 @@ using namespace neuro;
 using namespace std;
 namespace vrisp {
 class Network;
+class BatchNetwork;
 class Processor;
+class WorkerPool;
+
+/** In threaded mode, a charge whose destination belongs to another thread */
+struct Delivery {
+    size_t index; /**< Index into neuron_charge_buffer */
+    int8_t weight;
+};
+
+/** Where one network of load_networks() lives inside the packed network */
+struct PackedNetwork {
+    size_t node_base;   /**< Neuron index of the first node */
+    size_t input_base;  /**< Packed input id of input 0 */
+    size_t output_base; /**< Packed output id of output 0 */
+    size_t num_inputs;
+    size_t num_outputs;
+    vector<uint32_t> node_ids; /**< Neuron node_base+i is node node_ids[i] */
+};
+
+/** The parts of a vrisp network that running it never changes. Networks with
+ * the same content can share one, see "Network Cache" in markdown/vrisp.md.
+ * The fields are documented where Network refers to them. */
+struct Topology {
+    vector<bool> inputs;
+    vector<bool> outputs;
+    vector<size_t> input_mappings;
+    vector<size_t> output_mappings;
+    vector<size_t> neuron_mappings;
+    vector<int8_t, AlignmentAllocator<int8_t>> neuron_threshold;
+    vector<uint32_t> synapse_offsets;
+    vector<uint32_t, AlignmentAllocator<uint32_t>> synapse_to;
+    vector<uint8_t, AlignmentAllocator<uint8_t>> synapse_delay;
+    vector<int8_t, AlignmentAllocator<int8_t>> synapse_weight;
+    vector<bool> synapse_serial;
+    vector<uint8_t, AlignmentAllocator<uint8_t>> neuron_leak;
+    vector<uint32_t> always_active;
+};
 
 class Network {
   public:
     /** Convert network in framework format to an internal vrisp network */
 
     Network(neuro::Network* net, double _min_potential, char leak,
-            size_t tracked_timesteps, double spike_value_factor);
+            size_t tracked_timesteps, double spike_value_factor,
+            bool sort_synapses, double frontier_density, size_t threads);
+
+    /** A new network on the topology of another one, with its own state */
+    Network(shared_ptr<Topology> topology, double _min_potential, char leak,
+            size_t tracked_timesteps, double spike_value_factor,
+            double frontier_density, size_t threads);
     ~Network();
 
+    shared_ptr<Topology> get_topology() const;
+
     /* Mirror calls from the Processor API */
     void apply_spike(const Spike& s, bool normalized = true);
+    void apply_spikes(const vector<Spike>& s, bool normalized = true);
+    void apply_spikes(const vector<int>& input_ids, const vector<double>& times,
+                      const vector<double>& values, bool normalized = true);
     void run(size_t duration);
     double get_time();
+    bool track_output_events(int output_id, bool track);
+    bool track_neuron_events(uint32_t node_id, bool track);
 
     double output_last_fire(int output_id);
     vector<double> output_last_fires();
@@ -49,36 +99,109 @@ class Network {
     void clear_output_tracking();
 
   protected:
+    explicit Network(shared_ptr<Topology> t); /**< Binds the topology fields */
+    Network(neuro::Network* net, double _min_potential, char leak,
+            size_t tracked_timesteps,
+            double spike_value_factor); /**< No single-sample state */
+    void build_topology(neuro::Network* net, bool sort_synapses);
+    void init_settings(double _min_potential, char leak,
+                       size_t tracked_timesteps, double _spike_value_factor);
+    void init_state(double _min_potential, char leak, size_t tracked_timesteps,
+                    double _spike_value_factor, double frontier_density,
+                    size_t threads);
     void process_events(uint32_t time); /**< Process events at time "time" */
-
-    vector<bool> inputs;
-    vector<bool> outputs;
-
-    vector<size_t> input_mappings;
-    vector<size_t> output_mappings;
-    vector<size_t> neuron_mappings;
+    uint8_t* extend_fire_history(size_t duration);
+    void record_fires(size_t row, size_t p, uint8_t* history,
+                      long long& fires,
+                      long long& accumulates); /**< Count partition p of
+                                                  fired_bitmap */
+    int32_t spike_charge(const Spike& s, bool normalized) const;
+    size_t neuron_index(uint32_t node_id) const;
+    bool track_index_events(size_t i, bool track);
+    void queue_spike(const Spike& s, bool normalized);
+    void flush_spikes(); /**< Applies the spikes from queue_spike() */
+    void separate_synapse_conflicts(size_t chunk);
+    void deliver_serial(size_t i, size_t row);
+
+    /* Threaded mode, see markdown/vrisp.md */
+    void run_threaded(size_t duration);
+    template <char LEAK, bool ZERO_MIN, bool POW2>
+    void process_partition(uint32_t time, size_t row, size_t p);
+    void deliver_partition(size_t p);
+
+    /* Specialized kernels, see markdown/vrisp.md */
+    template <bool POW2> size_t ring_row(size_t timestep) const;
+    template <char LEAK, bool ZERO_MIN, bool POW2>
+    void process_dense(uint32_t time, size_t row);
+    void select_kernels();
+
+    typedef void (Network::*DenseKernel)(uint32_t time, size_t row);
+    typedef void (Network::*PartitionKernel)(uint32_t time, size_t row,
+                                             size_t p);
+    DenseKernel dense_kernel; /**< process_dense() for this network */
+    PartitionKernel partition_kernel; /**< process_partition() for this
+                                         network */
+
+    /* Sparse-activity frontier mode, see markdown/vrisp.md */
+    void frontier_touch(size_t row, size_t neuron);
+    void process_frontier(uint32_t time, size_t row); /**< Sparse timestep */
+    void record_dense_frontier(size_t row); /**< Touches made by a dense
+                                               timestep on later rows */
+    void clear_frontier_row(size_t row);
+
+    shared_ptr<Topology> topology; /**< The references below are its fields */
+
+    vector<bool>& inputs;
+    vector<bool>& outputs;
+
+    vector<size_t>& input_mappings;  /**< Input id to neuron index */
+    vector<size_t>& output_mappings; /**< Output id to neuron index */
+    vector<size_t>& neuron_mappings; /**< Neuron index to node id */
 
     size_t neuron_count;
     size_t allocation_size;
     size_t tracked_timesteps_count;
 
-    vector<uint8_t, AlignmentAllocator<uint8_t>>
+    vector<uint32_t, AlignmentAllocator<uint32_t>>
         output_fire_count; /**< Number of fires since last run() call*/
-    vector<int8_t, AlignmentAllocator<int8_t>> output_last_fire_timestep;
+    vector<int32_t, AlignmentAllocator<int32_t>> output_last_fire_timestep;
     /**<
                  Timestep of last firing for this neuron */
-    vector<int8_t, AlignmentAllocator<int8_t>>
+    vector<bool> neuron_tracked; /**< Does neuron_vectors() report this
+                                    neuron's fire times */
+    size_t tracked_neuron_count; /**< While nonzero, fires are recorded */
+    vector<uint8_t, AlignmentAllocator<uint8_t>>
+        fired_bitmap; /**< Neurons that fired this timestep */
+    vector<uint8_t> fire_history; /**< One fired_bitmap row for each timestep
+                                     of the last run() call */
+    long long neuron_fire_counter;  /**< What total_neuron_counts() returns */
+    long long neuron_accum_counter; /**< What total_neuron_accumulates()
+                                       returns */
+    vector<long long>
+        pending_accumulates; /**< For each partition and ring buffer row, the
+                                charges sent to that row */
+    vector<int8_t, AlignmentAllocator<int8_t>>&
         neuron_threshold; /**< Neuron's threshold*/
-    vector<vector<uint16_t, AlignmentAllocator<uint16_t>>>
+    vector<uint32_t>&
+        synapse_offsets; /**< CSR row pointers: neuron i's synapses are the
+                            entries [synapse_offsets[i], synapse_offsets[i+1])
+                            of the three synapse arrays below */
+    vector<uint32_t, AlignmentAllocator<uint32_t>>&
         synapse_to; /**< Which neuron does this synapse go to*/
-    vector<vector<uint8_t, AlignmentAllocator<uint8_t>>>
+    vector<uint8_t, AlignmentAllocator<uint8_t>>&
         synapse_delay; /**< How much delay does this synapse have*/
-    vector<vector<int8_t, AlignmentAllocator<int8_t>>>
+    vector<int8_t, AlignmentAllocator<int8_t>>&
         synapse_weight;           /**< What is this synapses weight*/
+    vector<bool>& synapse_serial; /**< Neurons whose synapses cannot be split
+                                     into conflict-free vector chunks */
+    vector<pair<uint32_t, int32_t>>
+        spike_queue; /**< (charge buffer slot, charge) for apply_spikes() */
+    vector<uint32_t, AlignmentAllocator<uint32_t>> spike_slots;
+    vector<int8_t, AlignmentAllocator<int8_t>> spike_charges;
     int8_t* neuron_charge_buffer; /**< Ring buffer for each neuron, this is a
                                      2D array, with `tracked_timesteps_count`
                                      rows, and `neuron_count` cols*/
-    vector<uint8_t, AlignmentAllocator<uint8_t>>
+    vector<uint8_t, AlignmentAllocator<uint8_t>>&
         neuron_leak; /**< Bitmap, Cannot use vector<bool> as it does not allow
                         direct access to the backing store, and is
                         implementation dependent*/
@@ -86,8 +209,69 @@ class Network {
     size_t current_timestep; /**< This is what get_time() returns. */
     double min_potential; /**< At the end of a timestep, pin the charge to this
                              if less than. */
+    int8_t min_potential_charge; /**< min_potential, saturated to a charge */
+    bool ring_is_power_of_two; /**< Wrap ring buffer rows with a mask */
     char leak_mode; /**< 'a' for all, 'n' for nothing, 'c' for configurable */
     double spike_value_factor;
+
+    bool frontier_enabled; /**< True if frontier_density > 0 */
+    size_t frontier_limit; /**< A row with more touched neurons than this is
+                              swept densely */
+    vector<vector<uint32_t>>
+        frontier; /**< For each ring buffer row, the neurons whose charge in
+                     that row has been touched */
+    vector<uint8_t, AlignmentAllocator<uint8_t>>
+        frontier_touched; /**< Bitmap with the same shape as the charge
+                             buffer, so `frontier` holds no duplicates */
+    vector<uint8_t> frontier_dense; /**< For each ring buffer row, set when
+                                       `frontier` overflowed frontier_limit */
+    vector<uint32_t>& always_active; /**< Neurons with threshold <= 0, which
+                                       fire even when untouched */
+
+    size_t thread_count;
+    size_t partition_size; /**< Neurons per thread, a multiple of 16 */
+    vector<vector<vector<Delivery>>>
+        outboxes; /**< outboxes[p][q] holds the charges that thread p sends
+                     to neurons in thread q's partition */
+    unique_ptr<WorkerPool> pool; /**< Threads 1 and up, kept between runs */
+};
+
+/** Sample-lane batching: one network, run on many independent samples at
+ * once. The charge buffer is laid out [timestep][neuron][sample], so that the
+ * same neuron is updated for every sample together. Only output counts,
+ * output last fires and charges are recorded. See markdown/vrisp.md. */
+class BatchNetwork : protected Network {
+  public:
+    BatchNetwork(neuro::Network* net, double _min_potential, char leak,
+                 size_t tracked_timesteps, double spike_value_factor,
+                 size_t samples);
+    ~BatchNetwork();
+
+    size_t get_samples() const;
+    void apply_spike(const Spike& s, size_t sample, bool normalized = true);
+    void run(size_t duration);
+    using Network::get_time;
+
+    vector<int> output_counts(size_t sample);
+    vector<double> output_last_fires(size_t sample);
+    vector<double> neuron_charges(size_t sample);
+
+    void clear_activity();
+    void clear_output_tracking();
+
+  protected:
+    void process_batch(uint32_t time, size_t row);
+    void check_sample(size_t sample) const;
+
+    size_t samples;
+    size_t lanes;    /**< samples, rounded up to a multiple of 16 */
+    size_t row_size; /**< neuron_count * lanes */
+    int8_t* batch_charge_buffer; /**< `tracked_timesteps_count` rows of
+                                    `neuron_count` blocks of `lanes` */
+    vector<uint8_t> fired;       /**< Which lanes fired, for one neuron */
+    vector<int> output_slot;     /**< Neuron index to output id, or -1 */
+    vector<uint32_t> batch_fire_count; /**< [output id][lane] */
+    vector<int32_t> batch_last_fire;   /**< [output id][lane] */
 };
 
 class Processor : public neuro::Processor {
@@ -111,6 +295,11 @@ class Processor : public neuro::Processor {
     void apply_spikes(const vector<Spike>& s, const vector<int>& network_ids,
                       bool normalized = true);
 
+    /* Bulk spikes as parallel arrays, see markdown/vrisp.md */
+    void apply_spikes(const vector<int>& input_ids, const vector<double>& times,
+                      const vector<double>& values, bool normalized = true,
+                      int network_id = 0);
+
     /* Run the network(s) for the desired time with queued inputs */
 
     void run(double duration, int network_id = 0);
@@ -119,7 +308,7 @@ class Processor : public neuro::Processor {
     /* Get processor time based on specified network */
     double get_time(int network_id = 0);
 
-    /* Output tracking. NOTE: Probably won't implement exactly, or at all */
+    /* Output tracking.  See markdown/vrisp.md for what is recorded. */
     bool track_output_events(int output_id, bool track = true,
                              int network_id = 0);
     bool track_neuron_events(uint32_t node_id, bool track = true,
@@ -151,6 +340,18 @@ class Processor : public neuro::Processor {
     /* Remove state, keep network loaded */
     void clear_activity(int network_id = 0);
 
+    /* Sample-lane batching: run one network on many samples at once. These
+       are separate from the networks above. */
+    bool load_batch(neuro::Network* n, size_t samples, int batch_id = 0);
+    void clear_batch(int batch_id = 0);
+    void apply_batch_spike(const Spike& s, size_t sample,
+                           bool normalized = true, int batch_id = 0);
+    void run_batch(double duration, int batch_id = 0);
+    vector<int> batch_output_counts(size_t sample, int batch_id = 0);
+    vector<double> batch_output_last_fires(size_t sample, int batch_id = 0);
+    vector<double> batch_neuron_charges(size_t sample, int batch_id = 0);
+    void clear_batch_activity(int batch_id = 0);
+
     /* Network/Processor Properties */
     PropertyPack get_network_properties() const;
     json get_processor_properties() const;
@@ -159,7 +360,19 @@ class Processor : public neuro::Processor {
 
   protected:
     vrisp::Network* get_vrisp_network(int network_id);
+    vrisp::BatchNetwork* get_batch(int batch_id);
+    const PackedNetwork* get_packed(int network_id) const;
+    bool check_network(neuro::Network* net, const string& rln);
+    bool pack_loaded_networks(std::vector<neuro::Network*>& n);
     map<int, vrisp::Network*> networks;
+    map<int, vrisp::BatchNetwork*> batches;
+
+    /* Packed networks, see markdown/vrisp.md */
+    vrisp::Network* pack;            /**< All networks of load_networks() */
+    map<int, PackedNetwork> packed; /**< Network id to its place in pack */
+
+    /* Compiled topologies by content_hash(), see markdown/vrisp.md */
+    NetworkCache<Topology> topology_cache;
 
     double min_weight;
     double max_weight;
@@ -169,6 +382,12 @@ class Processor : public neuro::Processor {
     string leak_mode;
     double spike_value_factor;
     size_t tracked_timesteps_count;
+    bool sort_synapses;
+    double frontier_density;
+    size_t threads;
+    bool power_of_two_timesteps;
+    bool pack_networks;
+    size_t network_cache; /**< Capacity of topology_cache */
 
     uint32_t min_delay;
     uint32_t max_delay;
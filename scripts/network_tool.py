@@ -622,9 +622,9 @@ def main():
         elif sv[0] == "CLEAR_VIZ":
             nodes = n.get_node_map()
             for node in nodes.values():
-                node.coordinates.clear()
+                node.coordinates = []
                 for outgoing in node.outgoing:
-                    outgoing.control_point.clear()
+                    outgoing.control_point = []
         elif sv[0] == "SET_CP":
             if size < 3:
                 print("usage: SET_CP from to [x] [y] - Set the control points of an edge. This is used by viz")
@@ -45,10 +45,19 @@ for i in $t ; do
   ( echo M risp tmp_proc_params.txt
     echo EMPTYNET tmp_empty_network.txt ) | bin/processor_tool_risp
 
-  # Use network_tool.txt to create the network.
+  # Use network_tool.txt to create the network.  It shouldn't print anything,
+  # unless there's a correct_nt_output.txt, which its output has to match.
 
   bin/network_tool < testing/$i/network_tool.txt > tmp_nt_output.txt 2>&1
-  if [ `wc tmp_nt_output.txt | awk '{ print $1 }'` != 0 ]; then
+  if [ -f testing/$i/correct_nt_output.txt ]; then
+    if ! cmp -s tmp_nt_output.txt testing/$i/correct_nt_output.txt; then
+      echo "Test $i - $l" >&2
+      echo "Error: The network_tool output does not match the correct output." >&2
+      echo "       Output file is tmp_nt_output.txt" >&2
+      echo "       Correct output file is testing/$i/correct_nt_output.txt" >&2
+      exit 1
+    fi
+  elif [ `wc tmp_nt_output.txt | awk '{ print $1 }'` != 0 ]; then
     echo "Test $i - $l" >&2
     echo "There was an error in the network_tool command when I ran:" >&2
     echo "" >&2
@@ -58,6 +67,19 @@ for i in $t ; do
     exit 1
   fi
 
+  # If there's a correct_network.txt, then the network that network_tool.txt
+  # wrote has to match it byte for byte.
+
+  if [ -f testing/$i/correct_network.txt ]; then
+    if ! cmp -s tmp_network.txt testing/$i/correct_network.txt; then
+      echo "Test $i - $l" >&2
+      echo "Error: The network does not match the correct network." >&2
+      echo "       Network file is tmp_network.txt" >&2
+      echo "       Correct network file is testing/$i/correct_network.txt" >&2
+      exit 1
+    fi
+  fi
+
   # Now, you'll execute the commands in processor_tool.txt and compare the output
   # against known output.
 
@@ -87,6 +109,8 @@ for i in $t ; do
   if [ $keep = no ]; then
     rm -f tmp_proc_params.txt \
           tmp_network.txt \
+          tmp_network.txt.gz \
+          tmp_network.bin.gz \
           tmp_nt_output.txt \
           tmp_pt_output.txt \
           tmp_pt_input.txt \
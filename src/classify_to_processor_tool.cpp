@@ -10,9 +10,13 @@
 
 #include "framework.hpp"
 #include "utils/json_helpers.hpp"
+#include "utils/file_helpers.hpp"
 
 using namespace std;
 using nlohmann::json;
+using neuro::InputFile;
+using neuro::OutputFile;
+using neuro::cin_from_compressed_file;
 
 typedef std::runtime_error SRE;
 
@@ -84,7 +88,7 @@ bool read_json(const vector <string> &sv, size_t starting_field, json &rv)
 {
   bool success;
   string s;
-  ifstream fin;
+  InputFile fin;
 
   rv.clear();
   if (starting_field < sv.size()) {
@@ -126,7 +130,6 @@ int main(int argc, char **argv)
   string prompt, cmd;
   string l,s;
   string command;
-  FILE *f;
   double threshold;
   int sim_time, head_bn_id;
   size_t i;
@@ -140,7 +143,7 @@ int main(int argc, char **argv)
 
   json proc_params, network_json, features_json, categories_json;
 
-  ofstream fout;
+  OutputFile fout;
 
   istringstream ss;
 
@@ -158,6 +161,8 @@ int main(int argc, char **argv)
   prompt += " ";
   }
 
+  cin_from_compressed_file();
+
   proc_name.clear();
   proc_params.clear();
   network_json.clear();
@@ -170,7 +175,13 @@ int main(int argc, char **argv)
   while(1) {
     try {
       if (prompt != "") printf("%s", prompt.c_str());
-      if (!getline(cin, l)) exit(0);
+      if (!getline(cin, l)) {
+        if (cin.bad()) {
+          fprintf(stderr, "Error reading the commands.\n");
+          exit(1);
+        }
+        exit(0);
+      }
       sv.clear();
       ss.clear();
       ss.str(l);
@@ -256,9 +267,14 @@ int main(int argc, char **argv)
         if (!isBuilt) printf("Must run BUILD before WRITE\n");
         if (sv.size() != 2) printf("usage: WRITE filename\n");
         else {
-          f = fopen(sv[1].c_str(), "w+");
-          fprintf(f, "%s", command.c_str());
-          fclose(f);
+          fout.clear();
+          fout.open(sv[1]);
+          if (fout.fail()) {
+            perror(sv[1].c_str());
+          } else {
+            fout << command;
+            fout.close();
+          }
         }
       } else {
         printf("Invalid command %s.  Use '?' to print a list of commands.\n", sv[0].c_str());
@@ -304,7 +320,7 @@ void read_csv_files(vector < Observation* > &data_obs,
                     const set < string > &json_categories,
                     vector < string > &categories)
 {
-  fstream in;
+  InputFile in;
   int fpo;
   istringstream ss, val_get;
   string line, dline, label, s;
@@ -343,7 +359,7 @@ void read_csv_files(vector < Observation* > &data_obs,
   vector <string> sv;
 
   /* read data file */
-  in.open(data_csv, ios::in);
+  in.open(data_csv);
   if (!in.is_open()) throw SRE("Can't open data csv file " + data_csv);
 
   o = NULL;
@@ -556,7 +572,7 @@ void read_csv_files(vector < Observation* > &data_obs,
     labels_set/labels_int_set.
    */
 
-  in.open(labels_csv, ios::in);
+  in.open(labels_csv);
   if (!in.is_open()) throw SRE("Can't open the label csv file " + labels_csv);
 
   while(getline(in, line, ',')) {
@@ -0,0 +1,210 @@
+/* Plain and gzip-compressed files behind one stream interface.  See
+   include/utils/file_helpers.hpp. */
+
+#include "file_helpers.hpp"
+#include <cerrno>
+#include <stdexcept>
+#include <zlib.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+namespace neuro
+{
+using std::string;
+
+static const size_t gz_buffer_size = 1 << 16;
+
+static bool ends_with(const string &s, const string &suffix)
+{
+  return (s.size() >= suffix.size() &&
+          s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0);
+}
+
+/* zstd's library isn't one that we can count on being installed, so rather than
+   read a .zst file as garbage, we fail to open it, the way that ifstream would, with
+   errno set for perror(). */
+
+static bool supported(const string &filename)
+{
+  if (!ends_with(filename, ".zst")) return true;
+  errno = ENOTSUP;
+  return false;
+}
+
+bool file_is_compressed(const string &filename)
+{
+  return ends_with(filename, ".gz");
+}
+
+GzStreamBuf::~GzStreamBuf()
+{
+  close();
+}
+
+bool GzStreamBuf::open(const string &filename, bool write)
+{
+  if (m_gz != nullptr) return false;
+  m_gz = gzopen(filename.c_str(), write ? "wb" : "rb");
+  if (m_gz == nullptr) return false;
+  gzbuffer(m_gz, gz_buffer_size);
+  m_write = write;
+  m_buf.resize(gz_buffer_size);
+  if (write) {
+    setp(m_buf.data(), m_buf.data() + m_buf.size());
+  } else {
+    setg(m_buf.data(), m_buf.data(), m_buf.data());
+  }
+  return true;
+}
+
+bool GzStreamBuf::dopen(int fd)
+{
+  if (m_gz != nullptr) return false;
+  m_gz = gzdopen(fd, "rb");
+  if (m_gz == nullptr) return false;
+  gzbuffer(m_gz, gz_buffer_size);
+  m_write = false;
+  m_buf.resize(gz_buffer_size);
+  setg(m_buf.data(), m_buf.data(), m_buf.data());
+  return true;
+}
+
+bool GzStreamBuf::flush_buffer()
+{
+  int n;
+
+  n = pptr() - pbase();
+  if (n > 0 && gzwrite(m_gz, pbase(), n) != n) return false;
+  setp(m_buf.data(), m_buf.data() + m_buf.size());
+  return true;
+}
+
+bool GzStreamBuf::close()
+{
+  bool ok;
+
+  if (m_gz == nullptr) return true;
+  ok = true;
+  if (m_write && !flush_buffer()) ok = false;
+  if (gzclose(m_gz) != Z_OK) ok = false;
+  m_gz = nullptr;
+  setg(nullptr, nullptr, nullptr);
+  setp(nullptr, nullptr);
+  return ok;
+}
+
+/* gzread() returns -1 on a corrupt file, and 0 with Z_BUF_ERROR on a truncated one, so
+   both of those throw rather than look like the end of the file.  An istream catches the
+   exception and sets badbit.  Readers that pull from the streambuf directly, like the
+   json parser, see the exception itself. */
+
+GzStreamBuf::int_type GzStreamBuf::underflow()
+{
+  int n, err;
+  const char *msg;
+
+  if (m_gz == nullptr || m_write) return traits_type::eof();
+  if (gptr() < egptr()) return traits_type::to_int_type(*gptr());
+  n = gzread(m_gz, m_buf.data(), m_buf.size());
+  if (n <= 0) {
+    msg = gzerror(m_gz, &err);
+    if (n < 0 || err != Z_OK) {
+      throw std::runtime_error((string) "Error reading a gzip file: " + msg);
+    }
+    return traits_type::eof();
+  }
+  setg(m_buf.data(), m_buf.data(), m_buf.data() + n);
+  return traits_type::to_int_type(*gptr());
+}
+
+GzStreamBuf::int_type GzStreamBuf::overflow(int_type c)
+{
+  if (m_gz == nullptr || !m_write) return traits_type::eof();
+  if (!flush_buffer()) return traits_type::eof();
+  if (!traits_type::eq_int_type(c, traits_type::eof())) {
+    *pptr() = traits_type::to_char_type(c);
+    pbump(1);
+  }
+  return traits_type::not_eof(c);
+}
+
+int GzStreamBuf::sync()
+{
+  if (m_gz == nullptr || !m_write) return 0;
+  return flush_buffer() ? 0 : -1;
+}
+
+void InputFile::open(const string &filename)
+{
+  bool ok;
+
+  if (!supported(filename)) {
+    ok = false;
+  } else if (file_is_compressed(filename)) {
+    ok = m_gz.open(filename, false);
+    rdbuf(&m_gz);
+  } else {
+    ok = (m_file.open(filename.c_str(), std::ios::in | std::ios::binary) != nullptr);
+    rdbuf(&m_file);
+  }
+  if (ok) clear(); else setstate(std::ios::failbit);
+}
+
+void InputFile::close()
+{
+  m_file.close();
+  m_gz.close();
+}
+
+void OutputFile::open(const string &filename)
+{
+  bool ok;
+
+  if (!supported(filename)) {
+    ok = false;
+  } else if (file_is_compressed(filename)) {
+    ok = m_gz.open(filename, true);
+    rdbuf(&m_gz);
+  } else {
+    ok = (m_file.open(filename.c_str(), std::ios::out | std::ios::trunc | std::ios::binary) != nullptr);
+    rdbuf(&m_file);
+  }
+  if (ok) clear(); else setstate(std::ios::failbit);
+}
+
+void OutputFile::close()
+{
+  bool ok;
+
+  ok = true;
+  if (m_file.is_open() && m_file.close() == nullptr) ok = false;
+  if (m_gz.is_open() && !m_gz.close()) ok = false;
+  if (!ok) setstate(std::ios::failbit);
+}
+
+/* A regular file can be peeked at with pread(), which leaves the offset where it is. */
+
+void cin_from_compressed_file()
+{
+  static GzStreamBuf buf;
+  struct stat st;
+  unsigned char magic[2];
+  off_t offset;
+  int fd;
+
+  if (buf.is_open()) return;
+  if (fstat(0, &st) != 0 || !S_ISREG(st.st_mode)) return;
+  offset = lseek(0, 0, SEEK_CUR);
+  if (offset < 0 || pread(0, magic, 2, offset) != 2) return;
+  if (magic[0] != 0x1f || magic[1] != 0x8b) return;
+
+  fd = dup(0);
+  if (fd < 0) return;
+  if (!buf.dopen(fd)) {
+    ::close(fd);
+    return;
+  }
+  std::cin.rdbuf(&buf);
+}
+
+}   // End of neuro namespace.
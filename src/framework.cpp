@@ -1,9 +1,18 @@
 #include "framework.hpp"
 #include <cstdio>
-#include "robinhood/robin_set.h"
 #include "utils/json_helpers.hpp"
 #include <cmath>
 #include <iostream>
+#include <fstream>
+#include <sstream>
+#include <set>
+#include <algorithm>
+#include <cstring>
+#include <new>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 typedef std::runtime_error SRE;
 
@@ -45,10 +54,130 @@ static json edge_specs = {
    { "control_point", "A" },
      { "Necessary", { "from", "to", "values", } } };
 
+/* An edge read by from_json_stream() before its nodes. */
+
+struct PendingEdge {
+  uint32_t from;
+  uint32_t to;
+  vector <double> values;
+  vector <double> control_point;
+};
+
 static const vector<string> required_edge_keys { "from", "to", "values" };
 
 static bool node_comp(Node *n1, Node *n2) { return (n1->id < n2->id); }
 
+/* Take e out of from->outgoing or to->incoming by swapping the last edge into its
+   place, and patching that edge's index.  If the index is off, because someone has
+   been editing the vector, we fall back to looking for e. */
+
+static void unlink_edge(Edge *e, bool outgoing)
+{
+  vector <Edge *> &v = (outgoing) ? e->from->outgoing : e->to->incoming;
+  size_t i;
+  Edge *last;
+  char buf[200];
+
+  i = (outgoing) ? e->out_index : e->in_index;
+  if (i >= v.size() || v[i] != e) {
+    i = std::find(v.begin(), v.end(), e) - v.begin();
+    if (i == v.size()) {
+      snprintf(buf, 200, "Edge %u -> %u is missing from the %s edges of node %u.",
+               e->from->id, e->to->id, (outgoing) ? "outgoing" : "incoming",
+               (outgoing) ? e->from->id : e->to->id);
+      throw SRE(buf);
+    }
+  }
+
+  last = v.back();
+  v[i] = last;
+  if (outgoing) last->out_index = i; else last->in_index = i;
+  v.pop_back();
+}
+
+const size_t ValueStore::chunk_bits;
+const size_t ValueStore::chunk_size;
+
+ValueRow& ValueRow::operator=(const ValueRow &r)
+{
+    size_t i;
+
+    if (store == nullptr) {
+      if (this != &r) detached.reset(new vector<double>(r.to_vector()));
+      return *this;
+    }
+    if (r.size() != size()) {
+      throw SRE("ValueRow: cannot assign " + std::to_string(r.size()) + " values to a row of " +
+                std::to_string(size()));
+    }
+    for (i = 0; i < size(); i++) (*this)[i] = r[i];
+    return *this;
+}
+
+ValueRow& ValueRow::operator=(const vector<double> &v)
+{
+    size_t i;
+
+    if (store == nullptr) {
+      detached.reset(new vector<double>(v));
+      return *this;
+    }
+    if (v.size() != size()) {
+      throw SRE("ValueRow: cannot assign " + std::to_string(v.size()) + " values to a row of " +
+                std::to_string(size()));
+    }
+    for (i = 0; i < size(); i++) (*this)[i] = v[i];
+    return *this;
+}
+
+ValueRef ValueRow::at(size_t i)
+{
+    if (i >= size()) throw std::out_of_range("ValueRow::at()");
+    return (*this)[i];
+}
+
+const double& ValueRow::at(size_t i) const
+{
+    if (i >= size()) throw std::out_of_range("ValueRow::at()");
+    return (*this)[i];
+}
+
+vector<double> ValueRow::to_vector() const
+{
+    vector<double> rv(size());
+    size_t i;
+
+    for (i = 0; i < rv.size(); i++) rv[i] = (*this)[i];
+    return rv;
+}
+
+bool operator==(const ValueRow &lhs, const ValueRow &rhs)
+{
+    size_t i;
+
+    if (lhs.size() != rhs.size()) return false;
+    for (i = 0; i < lhs.size(); i++) if (lhs[i] != rhs[i]) return false;
+    return true;
+}
+
+bool operator!=(const ValueRow &lhs, const ValueRow &rhs) { return !(lhs == rhs); }
+
+bool operator==(const ValueRow &lhs, const vector<double> &rhs)
+{
+    size_t i;
+
+    if (lhs.size() != rhs.size()) return false;
+    for (i = 0; i < lhs.size(); i++) if (lhs[i] != rhs[i]) return false;
+    return true;
+}
+
+bool operator!=(const ValueRow &lhs, const vector<double> &rhs) { return !(lhs == rhs); }
+
+void to_json(json &j, const ValueRow &r)
+{
+    j = r.to_vector();
+}
+
 void Node::set(int idx, double val)
 {
     values.at(idx) = val;
@@ -60,9 +189,9 @@ static json node_json(Node *n)
 
   rv = json::object();
   rv["id"] = n->id;
-  rv["values"] = (n->values.size() == 0) ? json::array() : (json) n->values;
-  if (n->name != "") rv["name"] = n->name;
-  if (n->coordinates.size() != 0) rv["coords"] = n->coordinates;
+  rv["values"] = (n->values.size() == 0) ? json::array() : json(n->values.to_vector());
+  if (n->get_name() != "") rv["name"] = n->get_name();
+  if (n->get_coordinates().size() != 0) rv["coords"] = n->get_coordinates();
   return rv;
 }
 
@@ -84,27 +213,73 @@ void Node::set(const string& name, double val)
 {
   int idx;
 
-  if(net == nullptr) throw std::runtime_error("No Network pointer is set for this node");
+  if(topology == nullptr) throw std::runtime_error("No Network pointer is set for this node");
    
-  Property p = net->m_properties.nodes.at(name);
+  Property p = topology->properties.nodes.at(name);
   if (val < p.min_value || val > p.max_value) tl_ne_set_error("Node", name, val, p);
 
-  idx = net->m_properties.nodes.at(name).index;
+  idx = topology->properties.nodes.at(name).index;
   set(idx, val);
 }
 
-double Node::get(int idx)
+double Node::get(int idx) const
 {
-    return values.at(idx);
+    return values.at(idx);   // The const row doesn't unshare the columns.
 }
 
-double Node::get(const string& name)
+double Node::get(const string& name) const
 {
-    if(net == nullptr) throw std::runtime_error("No Network pointer is set for this node");
-    int idx = net->m_properties.nodes.at(name).index;
+    if(topology == nullptr) throw std::runtime_error("No Network pointer is set for this node");
+    int idx = topology->properties.nodes.at(name).index;
     return get(idx);
 }
 
+/* The side tables only hold the names, coordinates and control points that aren't
+   empty, so a missing entry reads as an empty one. */
+
+static const string empty_name;
+static const vector <double> empty_doubles;
+
+const string& Node::get_name() const
+{
+  if (topology == nullptr || topology->node_names.empty()) return empty_name;
+  auto it = topology->node_names.find(this);
+  return (it == topology->node_names.end()) ? empty_name : it->second;
+}
+
+void Node::set_name(const string& name)
+{
+  NetworkTopology *t;
+
+  if (topology == nullptr) throw SRE("No Network pointer is set for this node");
+  t = const_cast<NetworkTopology *>(topology);
+  if (name == "") {
+    t->node_names.erase(this);
+  } else {
+    t->node_names[this] = name;
+  }
+}
+
+const vector<double>& Node::get_coordinates() const
+{
+  if (topology == nullptr || topology->node_coords.empty()) return empty_doubles;
+  auto it = topology->node_coords.find(this);
+  return (it == topology->node_coords.end()) ? empty_doubles : it->second;
+}
+
+void Node::set_coordinates(const vector<double>& coords)
+{
+  NetworkTopology *t;
+
+  if (topology == nullptr) throw SRE("No Network pointer is set for this node");
+  t = const_cast<NetworkTopology *>(topology);
+  if (coords.empty()) {
+    t->node_coords.erase(this);
+  } else {
+    t->node_coords[this] = coords;
+  }
+}
+
 json Edge::as_json() const
 {
   json rv;
@@ -112,8 +287,8 @@ json Edge::as_json() const
   rv = json::object();
   rv["from"] = from->id;
   rv["to"] = to->id;
-  rv["values"] = (values.size() == 0) ? json::array() : (json) values;
-  if (control_point.size() != 0) rv["control_point"] = control_point;
+  rv["values"] = (values.size() == 0) ? json::array() : json(values.to_vector());
+  if (get_control_point().size() != 0) rv["control_point"] = get_control_point();
   return rv;
 }
 
@@ -124,27 +299,51 @@ void Edge::set(int idx, double val)
 
 void Edge::set(const string& name, double val)
 {   
-    if(net == nullptr) throw SRE("No Network pointer is set for this edge");
+    if(topology == nullptr) throw SRE("No Network pointer is set for this edge");
 
-    Property p = net->m_properties.edges.at(name);
+    Property p = topology->properties.edges.at(name);
     if (val < p.min_value || val > p.max_value) tl_ne_set_error("Edge", name, val, p);
 
-    int idx = net->m_properties.edges.at(name).index;
+    int idx = topology->properties.edges.at(name).index;
     set(idx, val);
 }
 
-double Edge::get(int idx)
+double Edge::get(int idx) const
 {
     return values.at(idx);
 }
 
-double Edge::get(const string& name)
+double Edge::get(const string& name) const
 {
-    if(net == nullptr) throw std::runtime_error("No Network pointer is set for this edge");
-    int idx = net->m_properties.edges.at(name).index;
+    if(topology == nullptr) throw std::runtime_error("No Network pointer is set for this edge");
+    int idx = topology->properties.edges.at(name).index;
     return get(idx);
 }
 
+const vector<double>& Edge::get_control_point() const
+{
+  if (topology == nullptr || topology->control_points.empty()) return empty_doubles;
+  auto it = topology->control_points.find(this);
+  return (it == topology->control_points.end()) ? empty_doubles : it->second;
+}
+
+void Edge::set_control_point(const vector<double>& cp)
+{
+  NetworkTopology *t;
+
+  if (topology == nullptr) throw SRE("No Network pointer is set for this edge");
+  t = const_cast<NetworkTopology *>(topology);
+  if (cp.empty()) {
+    t->control_points.erase(this);
+  } else {
+    t->control_points[this] = cp;
+  }
+}
+
+Network::Network() : m_topology(std::make_shared <NetworkTopology>())
+{
+}
+
 Network::Network(const Network& net)
 {
     copy_from(net);
@@ -169,7 +368,127 @@ Network& Network::operator=(Network&& net)
 
 Network::~Network() noexcept
 {
-    // Nothing needed right now?
+    // The topology goes when the last network that shares it does.
+}
+
+NetworkTopology::~NetworkTopology() noexcept
+{
+    // Dropping the columns and side tables first saves the nodes and edges from giving
+    // their slots and entries back.  The arenas go too, so they don't take slots back.
+    edge_values.clear();
+    node_values.clear();
+    clear_side_tables();
+    edge_arena.drop();
+    node_arena.drop();
+}
+
+void NetworkTopology::clear_side_tables()
+{
+    node_names.clear();
+    node_coords.clear();
+    control_points.clear();
+}
+
+void NetworkTopology::clear()
+{
+    edge_values.clear();
+    node_values.clear();
+    clear_side_tables();
+    edge_arena.drop();
+    node_arena.drop();
+    edges.clear();
+    nodes.clear();
+    edge_arena.clear();
+    node_arena.clear();
+}
+
+std::shared_ptr <NetworkTopology> NetworkTopology::clone() const
+{
+    std::shared_ptr <NetworkTopology> t;
+    size_t i, j;
+    const Node *on;
+    const Edge *oe;
+    Node *n;
+    Edge *e;
+
+    t = std::make_shared <NetworkTopology>();
+    t->properties = properties;
+    t->nodes.reserve(nodes.size());
+    t->edges.reserve(edges.size());
+    t->node_arena.reserve(nodes.size());
+    t->edge_arena.reserve(edges.size());
+    t->node_values.owners.reserve(nodes.size());
+    t->edge_values.owners.reserve(edges.size());
+
+    // Make the nodes and edges in the order of our value slots, so that the clone's
+    // slots are the same, and it can share our value chunks.
+
+    for (i = 0; i < node_values.owners.size(); i++) {
+      on = node_values.owners[i];
+      n = new (t->node_arena.allocate()) Node(on->id, t.get());
+      t->nodes.emplace(n->id, NodeMap::mapped_type(n));
+      t->node_values.adopt(n);
+      n->input_id = on->input_id;
+      n->output_id = on->output_id;
+      n->incoming.reserve(on->incoming.size());
+      n->outgoing.reserve(on->outgoing.size());
+    }
+
+    for (i = 0; i < edge_values.owners.size(); i++) {
+      oe = edge_values.owners[i];
+      e = new (t->edge_arena.allocate()) Edge(t->node_values.owners[oe->from->values.slot],
+                                              t->node_values.owners[oe->to->values.slot], t.get());
+      t->edges.emplace(make_pair(e->from->id, e->to->id), EdgeMap::mapped_type(e));
+      t->edge_values.adopt(e);
+    }
+
+    // The adjacency lists keep their order.
+
+    for (i = 0; i < node_values.owners.size(); i++) {
+      on = node_values.owners[i];
+      n = t->node_values.owners[i];
+      for (j = 0; j < on->outgoing.size(); j++) {
+        e = t->edge_values.owners[on->outgoing[j]->values.slot];
+        e->out_index = j;
+        n->outgoing.push_back(e);
+      }
+      for (j = 0; j < on->incoming.size(); j++) {
+        e = t->edge_values.owners[on->incoming[j]->values.slot];
+        e->in_index = j;
+        n->incoming.push_back(e);
+      }
+    }
+
+    t->node_values.columns = node_values.columns;
+    t->edge_values.columns = edge_values.columns;
+
+    for (auto &kv : node_names) t->node_names[t->node_values.owners[kv.first->values.slot]] = kv.second;
+    for (auto &kv : node_coords) t->node_coords[t->node_values.owners[kv.first->values.slot]] = kv.second;
+    for (auto &kv : control_points) {
+      t->control_points[t->edge_values.owners[kv.first->values.slot]] = kv.second;
+    }
+    return t;
+}
+
+void NodeDeleter::operator()(Node *n) const
+{
+    NetworkTopology *t = const_cast<NetworkTopology *>(n->topology);
+
+    t->node_values.remove(n);
+    if (!t->node_names.empty()) t->node_names.erase(n);
+    if (!t->node_coords.empty()) t->node_coords.erase(n);
+    n->~Node();
+    t->node_arena.release(n);
+}
+
+void EdgeDeleter::operator()(Edge *e) const
+{
+    NetworkTopology *t = const_cast<NetworkTopology *>(e->topology);
+
+    t->edge_values.remove(e);
+    if (!t->control_points.empty()) t->control_points.erase(e);
+    e->~Edge();
+    t->edge_arena.release(e);
 }
 
 bool Network::operator==(const Network &rhs) const
@@ -179,7 +498,7 @@ bool Network::operator==(const Network &rhs) const
     if(num_edges() != rhs.num_edges()) return false;
 
     // matching properties
-    if (m_properties != rhs.m_properties) return false;
+    if (m_topology->properties != rhs.m_topology->properties) return false;
 
     // matching network values
     if(values != rhs.values) return false;
@@ -191,12 +510,12 @@ bool Network::operator==(const Network &rhs) const
     if(m_outputs != rhs.m_outputs) return false;
 
     // matching nodes
-    for(auto &n : m_nodes)
+    for(auto &n : m_topology->nodes)
     {
         if(!rhs.is_node(n.first)) return false;
 
-        Node *n1 = n.second.get();
-        Node *n2 = rhs.get_node(n.first);
+        const Node *n1 = n.second.get();
+        const Node *n2 = rhs.get_node(n.first);
 
         if(n1->id != n2->id) return false;
         if(n1->input_id != n2->input_id) return false;
@@ -204,12 +523,12 @@ bool Network::operator==(const Network &rhs) const
     }
 
     // matching edges
-    for(auto &e : m_edges)
+    for(auto &e : m_topology->edges)
     {
         if(!rhs.is_edge(e.first.first, e.first.second)) return false;
 
-        Edge *e1 = e.second.get();
-        Edge *e2 = rhs.get_edge(e.first.first, e.first.second);
+        const Edge *e1 = e.second.get();
+        const Edge *e2 = rhs.get_edge(e.first.first, e.first.second);
 
         if(e1->from->id != e2->from->id) return false;
         if(e1->to->id != e2->to->id) return false;
@@ -221,70 +540,231 @@ bool Network::operator==(const Network &rhs) const
     return true;
 }
 
-void Network::copy_from(const Network& net)
+/* content_hash() runs 64-bit words through the splitmix64 finalizer.  Everything goes
+   in a fixed order -- nodes by id, and each node's edges by the id of their to node --
+   so equal networks hash the same, however they were built.  Zero and negative zero
+   hash the same too. */
+
+static uint64_t hash_mix(uint64_t x)
 {
-    m_properties = net.m_properties;
+  x ^= x >> 30;
+  x *= 0xbf58476d1ce4e5b9ULL;
+  x ^= x >> 27;
+  x *= 0x94d049bb133111ebULL;
+  x ^= x >> 31;
+  return x;
+}
 
-    // Copy nodes
-    for(auto& n : net.m_nodes)
-    {
-        Node *node = add_node(n.first);
-        
-        for(size_t i = 0; i < n.second->values.size(); i++)
-        {
-            node->values[i] = n.second->values[i];
-        }
+static void hash_word(uint64_t &h, uint64_t w)
+{
+  h = hash_mix(h ^ (w + 0x9e3779b97f4a7c15ULL));
+}
+
+static void hash_double(uint64_t &h, double d)
+{
+  uint64_t w;
+
+  if (d == 0) d = 0;
+  memcpy(&w, &d, sizeof(w));
+  hash_word(h, w);
+}
+
+static void hash_string(uint64_t &h, const string &s)
+{
+  uint64_t w;
+  size_t i;
+
+  hash_word(h, s.size());
+  for (i = 0; i < s.size(); i += 8) {
+    w = 0;
+    memcpy(&w, s.data() + i, std::min((size_t) 8, s.size() - i));
+    hash_word(h, w);
+  }
+}
+
+static bool edge_to_comp(Edge *e1, Edge *e2) { return (e1->to->id < e2->to->id); }
+
+uint64_t Network::content_hash(bool include_metadata) const
+{
+  vector <Node *> nodes;
+  vector <Edge *> edges;
+  NodeMap::const_iterator nit;
+  uint64_t h;
+  size_t i, j, k;
+  Node *n;
+  Edge *e;
+
+  h = 0;
+  hash_string(h, m_topology->properties.as_json().dump());
+  hash_word(h, values.size());
+  for (i = 0; i < values.size(); i++) hash_double(h, values[i]);
+  hash_word(h, m_inputs.size());
+  for (i = 0; i < m_inputs.size(); i++) hash_word(h, m_inputs[i]);
+  hash_word(h, m_outputs.size());
+  for (i = 0; i < m_outputs.size(); i++) hash_word(h, m_outputs[i]);
+  hash_word(h, m_topology->nodes.size());
+  hash_word(h, m_topology->edges.size());
+
+  nodes.reserve(m_topology->nodes.size());
+  for (nit = m_topology->nodes.begin(); nit != m_topology->nodes.end(); nit++) nodes.push_back(nit->second.get());
+  sort(nodes.begin(), nodes.end(), node_comp);
+
+  for (i = 0; i < nodes.size(); i++) {
+    n = nodes[i];
+    const ValueRow &nv = n->values;
+    hash_word(h, n->id);
+    hash_word(h, (int64_t) n->input_id);
+    hash_word(h, (int64_t) n->output_id);
+    for (k = 0; k < nv.size(); k++) hash_double(h, nv[k]);
+    if (include_metadata) {
+      const vector <double> &coords = n->get_coordinates();
+      hash_string(h, n->get_name());
+      hash_word(h, coords.size());
+      for (k = 0; k < coords.size(); k++) hash_double(h, coords[k]);
     }
 
-    // Copy edges
-    for(auto& e : net.m_edges)
-    {
-        Edge *edge = add_edge(e.first.first, e.first.second);
+    edges = n->outgoing;
+    sort(edges.begin(), edges.end(), edge_to_comp);
+    hash_word(h, edges.size());
+    for (j = 0; j < edges.size(); j++) {
+      e = edges[j];
+      const ValueRow &ev = e->values;
+      hash_word(h, e->to->id);
+      for (k = 0; k < ev.size(); k++) hash_double(h, ev[k]);
+      if (include_metadata) {
+        const vector <double> &cp = e->get_control_point();
+        hash_word(h, cp.size());
+        for (k = 0; k < cp.size(); k++) hash_double(h, cp[k]);
+      }
+    }
+  }
 
-        for(size_t i = 0; i < e.second->values.size(); i++)
-        {
-            edge->values[i] = e.second->values[i];
-        }
+  if (include_metadata) {
+    hash_string(h, (m_associated_data == nullptr) ? "{}" : m_associated_data.dump());
+  }
+  return h;
+}
+
+static size_t count_chunks(const ValueStore &vs, const ValueStore *other)
+{
+  size_t i, c, rv;
+
+  rv = 0;
+  for (i = 0; i < vs.columns.size(); i++) {
+    for (c = 0; c < vs.columns[i].size(); c++) {
+      if (other == nullptr) {
+        rv++;
+      } else if (i < other->columns.size() && c < other->columns[i].size() &&
+                 vs.columns[i][c] == other->columns[i][c]) {
+        rv++;
+      }
     }
+  }
+  return rv;
+}
+
+size_t Network::value_chunks() const
+{
+  return count_chunks(m_topology->node_values, nullptr) + count_chunks(m_topology->edge_values, nullptr);
+}
 
-    // Copy inputs
-    for(auto i : net.m_inputs)
-        add_input(i);
+size_t Network::shared_value_chunks(const Network &net) const
+{
+  return count_chunks(m_topology->node_values, &net.m_topology->node_values) +
+         count_chunks(m_topology->edge_values, &net.m_topology->edge_values);
+}
 
-    // Copy outputs
-    for(auto o : net.m_outputs)
-        add_output(o);
+bool Network::shares_topology(const Network &net) const
+{
+  return m_topology == net.m_topology;
+}
 
+void Network::copy_from(const Network& net)
+{
+    if (&net == this) return;
+
+    // We share net's topology until one of us changes it.  The nodes are the same,
+    // so the sorted index is too.
+
+    m_topology = net.m_topology;
+    m_inputs = net.m_inputs;
+    m_outputs = net.m_outputs;
     m_associated_data = net.m_associated_data;
     values = net.values;
-    sorted_node_vector.clear();
+    sorted_node_vector = net.sorted_node_vector;
+    m_sorted_base = net.m_sorted_base;
+    m_sorted_ids = net.m_sorted_ids;
+    m_sorted_pending = net.m_sorted_pending;
+    m_sorted_valid = net.m_sorted_valid;
 }
 
 void Network::move_from(Network&& net)
 {
-    m_properties = std::move(net.m_properties);
+    if (&net == this) return;
+
+    // net gets a new, empty topology, so that it's still usable.
 
-    m_nodes = std::move(net.m_nodes);
-    m_edges = std::move(net.m_edges);
+    m_topology = std::move(net.m_topology);
+    net.m_topology = std::make_shared <NetworkTopology>();
     m_inputs = std::move(net.m_inputs);
     m_outputs = std::move(net.m_outputs);
     m_associated_data = std::move(net.m_associated_data);
     values = std::move(net.values);
-    sorted_node_vector.clear();
+    sorted_node_vector = std::move(net.sorted_node_vector);
+    m_sorted_base = std::move(net.m_sorted_base);
+    m_sorted_ids = std::move(net.m_sorted_ids);
+    m_sorted_pending = std::move(net.m_sorted_pending);
+    m_sorted_valid = net.m_sorted_valid;
+    net.m_inputs.clear();
+    net.m_outputs.clear();
+    net.m_associated_data = json::object();
+    net.values.clear();
+    net.clear_sorted_index();
+}
+
+NetworkTopology &Network::own()
+{
+    std::shared_ptr <NetworkTopology> old;
+    size_t i;
+
+    if (m_topology.use_count() == 1) return *m_topology;
+
+    old = m_topology;
+    m_topology = old->clone();
+
+    // The sorted nodes have the same slots in the clone.  The merge's old vector may
+    // hold removed nodes, so without a sorted vector, the index starts over.
+
+    if (sorted_node_vector.size() != 0) {
+      for (i = 0; i < sorted_node_vector.size(); i++) {
+        sorted_node_vector[i] = m_topology->node_values.owners[sorted_node_vector[i]->values.slot];
+      }
+      m_sorted_base.clear();
+    } else {
+      clear_sorted_index();
+    }
+    return *m_topology;
 }
 
 void Network::clear(bool include_properties)
 {
-  if (include_properties) {
-    m_properties.clear();
-    values.clear();
+  std::shared_ptr <NetworkTopology> t;
+
+  // A shared topology is left to the copies, rather than cloned and cleared.
+
+  if (m_topology.use_count() != 1) {
+    t = std::make_shared <NetworkTopology>();
+    if (!include_properties) t->properties = m_topology->properties;
+    m_topology = t;
+  } else {
+    if (include_properties) m_topology->properties.clear();
+    m_topology->clear();
   }
+  if (include_properties) values.clear();
   m_inputs.clear();
   m_outputs.clear();
-  m_nodes.clear();
-  m_edges.clear();
   m_associated_data = json::object();
-  sorted_node_vector.clear();
+  clear_sorted_index();
 }
 
 json Network::as_json() const
@@ -299,17 +779,17 @@ void Network::to_json(json& j) const
     // Dump all the properties
     // If the properties aren't empty, save them into the JSON
 
-    j["Properties"] = m_properties.as_json();
+    j["Properties"] = m_topology->properties.as_json();
 
     j["Nodes"] = json::array();
-    for(auto& n : m_nodes)
+    for(auto& n : m_topology->nodes)
     {
         j["Nodes"].push_back(node_json(n.second.get()));
     }
     
     // Dump all edges
     j["Edges"] = json::array();
-    for(auto& e : m_edges)
+    for(auto& e : m_topology->edges)
     {
         j["Edges"].push_back(e.second.get()->as_json());
     }
@@ -329,28 +809,627 @@ void Network::to_json(json& j) const
 
 void Network::from_json(const json &j)
 {
-    json tmp_properties;
+    /* Check parameters. */
+
+    Parameter_Check_Json_T(j, network_specs);
+
+    clear(true);
+
+    /* Grab the properties, the Network values and any associated data. */
+
+    network_values_from_json(j);
+
+    // Add nodes /w values
+    // CHZ I didn't pass as reference because we may need to modify jn
+
+    for(auto jn : j["Nodes"]) node_from_json(jn);
+
+    // Add edges /w values
+
+    for(auto& je : j["Edges"]) edge_from_json(je);
+
+    // Add the inputs & outputs
+
+    io_from_json(j);
+}
+
+/* The streaming loader.  Nodes and edges are the bulk of a network, so the
+   SAX handler below builds them straight from the parser's events, checking
+   each key against node_specs or edge_specs as it arrives, and never puts them
+   in a json.  Everything else is small, and is built into a json as usual, with
+   empty "Nodes" and "Edges" arrays, so that from_json_stream() can check it
+   like from_json() does.
+
+   Networks written by to_json() have their keys in alphabetical order, so the
+   edges come before the nodes, and the properties come last.  So the edges
+   whose nodes aren't there yet are held until the parse is done.  The value
+   columns can't be shaped until the PropertyPack is known, so every element's
+   values are held in one flat array, and are checked and stored at the end. */
+
+class NetworkSax {
+public:
+  NetworkSax(Network *n) : net(n), depth(0), list(nullptr), in_element(false), numbers(nullptr) {}
+
+  json top;                       /* Everything but the nodes and edges */
+  vector <PendingEdge> pending;   /* Edges that came before their nodes */
+  vector <Node *> value_nodes;    /* The nodes and edges made so far.  Element i's */
+  vector <Edge *> value_edges;    /* values are value_data[first, second) of */
+  vector < std::pair <size_t, size_t> > node_spans;   /* node_spans[i] or */
+  vector < std::pair <size_t, size_t> > edge_spans;   /* edge_spans[i]. */
+  vector <double> value_data;
+
+  bool null()                     { return scalar(json(nullptr)); }
+  bool boolean(bool b)            { return scalar(json(b)); }
+  bool number_integer(json::number_integer_t v)   { return number(v, json(v)); }
+  bool number_unsigned(json::number_unsigned_t v) { return number(v, json(v)); }
+  bool number_float(json::number_float_t v, const json::string_t &) { return number(v, json(v)); }
+  bool string(json::string_t &v)
+  {
+    if (in_element && depth == 3 && field == "name") {
+      name = v;
+      return true;
+    }
+    return scalar(json(v));
+  }
+
+  bool binary(json::binary_t &v)  { return scalar(json(v)); }
+
+  bool key(json::string_t &k)
+  {
+    if (in_element && depth == 3) {
+      if (!list->contains(k)) throw SRE("Illegal parameter: " + k + "\n");
+      field = k;
+      seen.insert(k);
+    } else {
+      last_key = k;
+    }
+    return true;
+  }
+
+  bool start_object(std::size_t)
+  {
+    if (list != nullptr && depth == 2) {
+      in_element = true;
+      seen.clear();
+      values.clear();
+      extra.clear();
+      name.clear();
+    } else if (in_element) {
+      element_error();
+    } else {
+      dom_push(json::object());
+    }
+    depth++;
+    return true;
+  }
+
+  bool end_object()
+  {
+    depth--;
+    if (in_element && depth == 2) {
+      end_element();
+      in_element = false;
+    } else {
+      dom_stack.pop_back();
+    }
+    return true;
+  }
+
+  bool start_array(std::size_t)
+  {
+    if (in_element && depth == 3 && (*list)[field] == "A") {
+      numbers = (field == "values") ? &values : &extra;
+      numbers->clear();
+    } else if (in_element || (list != nullptr && depth == 2)) {
+      element_error();
+    } else {
+      if (depth == 1 && last_key == "Nodes") list = &node_specs;
+      if (depth == 1 && last_key == "Edges") list = &edge_specs;
+      dom_push(json::array());
+    }
+    depth++;
+    return true;
+  }
+
+  bool end_array()
+  {
+    depth--;
+    if (numbers != nullptr) {
+      numbers = nullptr;
+    } else {
+      if (depth == 1) list = nullptr;
+      dom_stack.pop_back();
+    }
+    return true;
+  }
+
+  template <class Exception>
+  bool parse_error(std::size_t, const std::string &, const Exception &ex)
+  {
+    throw ex;
+  }
+
+protected:
+  Network *net;
+  int depth;                   /* How many objects and arrays are open */
+  const json *list;            /* node_specs or edge_specs, inside "Nodes" or "Edges" */
+  bool in_element;             /* Inside one node or edge */
+  std::string field;           /* The element's key being read */
+  std::set <std::string> seen; /* The element's keys so far */
+  uint32_t ids[2];             /* id, or from and to */
+  vector <double> values;
+  vector <double> extra;       /* coords or control_point */
+  std::string name;
+  vector <double> *numbers;    /* Where an array's numbers go */
+
+  vector <json *> dom_stack;
+  std::string last_key;
+
+  /* Builds the json of everything but the nodes and edges. */
+
+  json *dom_push(json &&v)
+  {
+    json *j;
+
+    if (dom_stack.empty()) {
+      top = std::move(v);
+      j = &top;
+    } else if (dom_stack.back()->is_array()) {
+      dom_stack.back()->push_back(std::move(v));
+      j = &dom_stack.back()->back();
+    } else {
+      j = &(*dom_stack.back())[last_key];
+      *j = std::move(v);
+    }
+    if (j->is_structured()) dom_stack.push_back(j);
+    return j;
+  }
+
+  bool scalar(json &&v)
+  {
+    if (in_element || (list != nullptr && depth == 2)) element_error();
+    dom_push(std::move(v));
+    return true;
+  }
+
+  template <typename T>
+  bool number(T v, json &&j)
+  {
+    if (numbers != nullptr) {
+      numbers->push_back(v);
+    } else if (in_element && depth == 3 && (*list)[field] == "I") {
+      ids[(field == "to") ? 1 : 0] = v;
+    } else {
+      return scalar(std::move(j));
+    }
+    return true;
+  }
+
+  /* A value that node_specs or edge_specs doesn't allow. */
+
+  void element_error()
+  {
+    if (!in_element) throw SRE("JSON is not an object.\n");
+    if (numbers != nullptr) throw SRE("Parameter " + field + ": must be an array of numbers.\n");
+    if (field == "name") throw SRE("Parameter name: must be a string.\n");
+    if ((*list)[field] == "I") throw SRE("Parameter " + field + ": must be a number.\n");
+    throw SRE("Parameter " + field + ": must be a json array.\n");
+  }
+
+  void end_element()
+  {
+    std::string missing;
     Node *n;
     Edge *e;
-    string estring;
-    size_t i;
-    char buf[128];
-    uint32_t id;
 
-    /* Check parameters. */
+    for (const auto &k : (*list)["Necessary"]) {
+      if (seen.find(k) == seen.end()) missing += "Missing parameter " + k.dump() + "\n";
+    }
+    if (missing != "") throw SRE(missing);
+
+    if (list == &node_specs) {
+      n = net->add_node(ids[0]);
+      value_nodes.push_back(n);
+      node_spans.push_back(make_pair(value_data.size(), value_data.size() + values.size()));
+      value_data.insert(value_data.end(), values.begin(), values.end());
+      if (seen.count("coords")) n->set_coordinates(extra);
+      if (seen.count("name")) n->set_name(name);
+    } else if (net->is_node(ids[0]) && net->is_node(ids[1])) {
+      e = net->add_edge(ids[0], ids[1]);
+      value_edges.push_back(e);
+      edge_spans.push_back(make_pair(value_data.size(), value_data.size() + values.size()));
+      value_data.insert(value_data.end(), values.begin(), values.end());
+      if (seen.count("control_point")) e->set_control_point(extra);
+    } else {
+      pending.push_back(PendingEdge());
+      pending.back().from = ids[0];
+      pending.back().to = ids[1];
+      pending.back().values.swap(values);
+      if (seen.count("control_point")) pending.back().control_point.swap(extra);
+    }
+  }
+};
 
-    Parameter_Check_Json_T(j, network_specs);
+void Network::from_json_stream(std::istream &in)
+{
+    NetworkSax sax(this);
+    Edge *e;
+    size_t i, j, start, end;
 
     clear(true);
 
-    /* Grab the properties. */
-   
-    m_properties.from_json(j["Properties"]);
+    json::sax_parse(in, &sax);
+
+    Parameter_Check_Json_T(sax.top, network_specs);
+    network_values_from_json(sax.top);
+
+    /* Now that the PropertyPack is known, the columns can hold the values. */
+
+    m_topology->node_values.reshape(m_topology->properties.node_vec_size);
+    m_topology->edge_values.reshape(m_topology->properties.edge_vec_size);
+
+    for (i = 0; i < sax.value_nodes.size(); i++) {
+      std::tie(start, end) = sax.node_spans[i];
+      check_values(sax.value_nodes[i], end - start);
+      for (j = start; j < end; j++) sax.value_nodes[i]->values[j-start] = sax.value_data[j];
+    }
+
+    for (i = 0; i < sax.value_edges.size(); i++) {
+      std::tie(start, end) = sax.edge_spans[i];
+      check_values(sax.value_edges[i], end - start);
+      for (j = start; j < end; j++) sax.value_edges[i]->values[j-start] = sax.value_data[j];
+    }
+
+    for (i = 0; i < sax.pending.size(); i++) {
+      e = add_edge(sax.pending[i].from, sax.pending[i].to);
+      check_values(e, sax.pending[i].values.size());
+      e->values = sax.pending[i].values;
+      e->set_control_point(sax.pending[i].control_point);
+    }
+
+    io_from_json(sax.top);
+}
+
+void Network::from_json_file(const string &filename)
+{
+    InputFile fin;
+
+    fin.open(filename);
+    if (fin.fail()) throw SRE((string) "Network::from_json_file(): Cannot open " + filename);
+    from_json_stream(fin);
+}
+
+/* The binary network format.  See markdown/network.md for the layout.  Every
+   section starts on an 8-byte boundary, so a memory-mapped file can be read in
+   place. */
+
+static const char binary_magic[8] = { 'T', 'N', 'N', 'E', 'T', 'B', 'I', 'N' };
+static const uint32_t binary_version = 1;
+static const uint32_t binary_byte_order = 0x01020304;
+
+struct BinaryHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t byte_order;              /* binary_byte_order, as written by this machine */
+  uint64_t num_nodes;
+  uint64_t num_edges;
+  uint64_t num_inputs;
+  uint64_t num_outputs;
+  uint64_t node_vec_size;
+  uint64_t edge_vec_size;
+  uint64_t net_vec_size;
+  uint64_t properties[2];           /* Offset and size of the PropertyPack's json text */
+  uint64_t network_values;          /* double[net_vec_size] */
+  uint64_t node_ids;                /* uint32_t[num_nodes], sorted */
+  uint64_t node_values;             /* double[num_nodes][node_vec_size] */
+  uint64_t edge_offsets;            /* uint64_t[num_nodes+1] -- CSR row pointers */
+  uint64_t edge_to;                 /* uint32_t[num_edges] -- index of the to node */
+  uint64_t edge_values;             /* double[num_edges][edge_vec_size] */
+  uint64_t inputs;                  /* uint32_t[num_inputs] -- node ids */
+  uint64_t outputs;                 /* uint32_t[num_outputs] -- node ids */
+  uint64_t extras[2];               /* json text: names, coordinates and control points */
+  uint64_t associated_data[2];      /* json text */
+  uint64_t file_size;
+};
+
+static uint64_t binary_align(uint64_t offset)
+{
+  return (offset + 7) & ~((uint64_t) 7);
+}
+
+bool Network::is_binary_file(const string &filename)
+{
+  InputFile fin;
+  char magic[8];
+
+  fin.open(filename);
+  if (fin.fail()) return false;
+  fin.read(magic, 8);
+  return (fin.gcount() == 8 && memcmp(magic, binary_magic, 8) == 0);
+}
+
+void Network::save_binary(std::ostream &out) const
+{
+  BinaryHeader h;
+  vector <Node *> nodes;
+  vector <uint32_t> ids, edge_to;
+  vector <uint64_t> edge_offsets;
+  vector <double> node_values, edge_values;
+  vector <Edge *> edges;
+  string properties, extras, associated_data;
+  json jextras;
+  uint64_t offset;
+  size_t i, k;
+  Node *n;
+  Edge *e;
+  const ValueRow *row;     /* Read through const rows, so shared columns stay shared */
+
+  /* Nodes are in id order, and each node's edges are in the order of their to ids. */
+
+  for (auto &nit : m_topology->nodes) nodes.push_back(nit.second.get());
+  std::sort(nodes.begin(), nodes.end(), node_comp);
+
+  edge_offsets.push_back(0);
+  for (i = 0; i < nodes.size(); i++) {
+    n = nodes[i];
+    ids.push_back(n->id);
+    row = &n->values;
+    for (k = 0; k < row->size(); k++) node_values.push_back((*row)[k]);
+    if (n->get_name() != "") jextras["names"][std::to_string(n->id)] = n->get_name();
+    if (!n->get_coordinates().empty()) jextras["coords"][std::to_string(n->id)] = n->get_coordinates();
+
+    edges = n->outgoing;
+    std::sort(edges.begin(), edges.end(), [](Edge *a, Edge *b) { return a->to->id < b->to->id; });
+    for (k = 0; k < edges.size(); k++) {
+      e = edges[k];
+      edge_to.push_back(e->to->id);
+      row = &e->values;
+      for (size_t j = 0; j < row->size(); j++) edge_values.push_back((*row)[j]);
+      if (!e->get_control_point().empty()) {
+        jextras["control_points"].push_back({ e->from->id, e->to->id, e->get_control_point() });
+      }
+    }
+    edge_offsets.push_back(edge_to.size());
+  }
+
+  /* The to ids are only in ids once every node is, so edge_to holds ids until here. */
+
+  for (i = 0; i < edge_to.size(); i++) {
+    edge_to[i] = std::lower_bound(ids.begin(), ids.end(), edge_to[i]) - ids.begin();
+  }
+
+  properties = m_topology->properties.as_json().dump();
+  extras = jextras.is_null() ? "{}" : jextras.dump();
+  associated_data = (m_associated_data == nullptr) ? "{}" : m_associated_data.dump();
+
+  memset(&h, 0, sizeof(h));
+  memcpy(h.magic, binary_magic, 8);
+  h.version = binary_version;
+  h.byte_order = binary_byte_order;
+  h.num_nodes = nodes.size();
+  h.num_edges = edge_to.size();
+  h.num_inputs = m_inputs.size();
+  h.num_outputs = m_outputs.size();
+  h.node_vec_size = m_topology->properties.node_vec_size;
+  h.edge_vec_size = m_topology->properties.edge_vec_size;
+  h.net_vec_size = values.size();
+
+  offset = sizeof(h);
+  h.properties[0] = offset;            h.properties[1] = properties.size();
+  offset = binary_align(offset + properties.size());
+  h.network_values = offset;           offset += sizeof(double) * values.size();
+  h.node_ids = offset;                 offset = binary_align(offset + sizeof(uint32_t) * ids.size());
+  h.node_values = offset;              offset += sizeof(double) * node_values.size();
+  h.edge_offsets = offset;             offset += sizeof(uint64_t) * edge_offsets.size();
+  h.edge_to = offset;                  offset = binary_align(offset + sizeof(uint32_t) * edge_to.size());
+  h.edge_values = offset;              offset += sizeof(double) * edge_values.size();
+  h.inputs = offset;                   offset += sizeof(uint32_t) * m_inputs.size();
+  h.outputs = offset;                  offset += sizeof(uint32_t) * m_outputs.size();
+  offset = binary_align(offset);
+  h.extras[0] = offset;                h.extras[1] = extras.size();
+  offset = binary_align(offset + extras.size());
+  h.associated_data[0] = offset;       h.associated_data[1] = associated_data.size();
+  h.file_size = offset + associated_data.size();
+
+  /* Each section is written at its offset, padding with zeros. */
+
+  offset = 0;
+  auto put = [&](uint64_t at, const void *p, size_t size) {
+    static const char zeros[8] = { 0 };
+    out.write(zeros, at - offset);
+    out.write((const char *) p, size);
+    offset = at + size;
+  };
+
+  put(0, &h, sizeof(h));
+  put(h.properties[0], properties.data(), properties.size());
+  put(h.network_values, values.data(), sizeof(double) * values.size());
+  put(h.node_ids, ids.data(), sizeof(uint32_t) * ids.size());
+  put(h.node_values, node_values.data(), sizeof(double) * node_values.size());
+  put(h.edge_offsets, edge_offsets.data(), sizeof(uint64_t) * edge_offsets.size());
+  put(h.edge_to, edge_to.data(), sizeof(uint32_t) * edge_to.size());
+  put(h.edge_values, edge_values.data(), sizeof(double) * edge_values.size());
+  put(h.inputs, m_inputs.data(), sizeof(uint32_t) * m_inputs.size());
+  put(h.outputs, m_outputs.data(), sizeof(uint32_t) * m_outputs.size());
+  put(h.extras[0], extras.data(), extras.size());
+  put(h.associated_data[0], associated_data.data(), associated_data.size());
+
+  if (out.fail()) throw SRE("Network::save_binary(): write failed.");
+}
+
+void Network::save_binary(const string &filename) const
+{
+  OutputFile fout;
+
+  fout.open(filename);
+  if (fout.fail()) throw SRE((string) "Network::save_binary(): Cannot open " + filename);
+  save_binary(fout);
+  fout.close();
+  if (fout.fail()) throw SRE("Network::save_binary(): write failed.");
+}
+
+void Network::load_binary(std::istream &in)
+{
+  std::istreambuf_iterator <char> begin(in), end;
+  vector <char> data(begin, end);
+
+  from_binary(data.data(), data.size());
+}
+
+/* The file is memory-mapped, so nothing is copied but the network itself.  A compressed
+   file has to be decompressed into memory first. */
+
+void Network::load_binary(const string &filename)
+{
+  struct stat st;
+  void *data;
+  int fd;
+  InputFile fin;
+
+  if (file_is_compressed(filename)) {
+    fin.open(filename);
+    if (fin.fail()) throw SRE((string) "Network::load_binary(): Cannot open " + filename);
+    load_binary(fin);
+    return;
+  }
+
+  fd = open(filename.c_str(), O_RDONLY);
+  if (fd < 0) throw SRE((string) "Network::load_binary(): Cannot open " + filename);
+  if (fstat(fd, &st) != 0 || st.st_size == 0) {
+    close(fd);
+    throw SRE((string) "Network::load_binary(): " + filename + " is empty or unreadable.");
+  }
+  data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) throw SRE((string) "Network::load_binary(): Cannot map " + filename);
+
+  try {
+    from_binary((const char *) data, st.st_size);
+  } catch (...) {
+    munmap(data, st.st_size);
+    throw;
+  }
+  munmap(data, st.st_size);
+}
+
+void Network::from_binary(const char *data, size_t size)
+{
+  BinaryHeader h;
+  const uint32_t *ids, *edge_to, *io;
+  const uint64_t *edge_offsets;
+  const double *node_values, *edge_values, *net_values;
+  json extras;
+  size_t i, k;
+  Node *n;
+  Edge *e;
+  string estring = "Network::load_binary(): ";
+
+  auto check_section = [&](uint64_t offset, uint64_t count, uint64_t item, const char *what) {
+    if (offset > size || count > (size - offset) / item) {
+      throw SRE(estring + "the " + what + " run past the end of the file.");
+    }
+  };
+
+  if (size < sizeof(h)) throw SRE(estring + "the file is too small.");
+  memcpy(&h, data, sizeof(h));
+  if (memcmp(h.magic, binary_magic, 8) != 0) throw SRE(estring + "not a binary network file.");
+  if (h.byte_order != binary_byte_order) throw SRE(estring + "the file has the wrong byte order.");
+  if (h.version != binary_version) {
+    throw SRE(estring + "unsupported version " + std::to_string(h.version) + ".");
+  }
+  if (h.file_size != size) throw SRE(estring + "the file is truncated.");
+
+  check_section(h.properties[0], h.properties[1], 1, "properties");
+  check_section(h.network_values, h.net_vec_size, sizeof(double), "network values");
+  check_section(h.node_ids, h.num_nodes, sizeof(uint32_t), "nodes");
+  if (h.node_vec_size != 0) check_section(h.node_values, h.num_nodes, sizeof(double) * h.node_vec_size, "node values");
+  check_section(h.edge_offsets, h.num_nodes + 1, sizeof(uint64_t), "edge offsets");
+  check_section(h.edge_to, h.num_edges, sizeof(uint32_t), "edges");
+  if (h.edge_vec_size != 0) check_section(h.edge_values, h.num_edges, sizeof(double) * h.edge_vec_size, "edge values");
+  check_section(h.inputs, h.num_inputs, sizeof(uint32_t), "inputs");
+  check_section(h.outputs, h.num_outputs, sizeof(uint32_t), "outputs");
+  check_section(h.extras[0], h.extras[1], 1, "names and coordinates");
+  check_section(h.associated_data[0], h.associated_data[1], 1, "associated data");
+  if ((h.network_values | h.node_values | h.edge_offsets | h.edge_values) % 8 != 0 ||
+      (h.node_ids | h.edge_to | h.inputs | h.outputs) % 4 != 0) {
+    throw SRE(estring + "misaligned section.");
+  }
+
+  clear(true);
+
+  m_topology->properties.from_json(json::parse(data + h.properties[0], data + h.properties[0] + h.properties[1]));
+  if (h.node_vec_size != m_topology->properties.node_vec_size ||
+      h.edge_vec_size != m_topology->properties.edge_vec_size ||
+      h.net_vec_size != m_topology->properties.net_vec_size) {
+    throw SRE(estring + "the value sizes do not match the PropertyPack.");
+  }
+
+  net_values = (const double *) (data + h.network_values);
+  values.assign(net_values, net_values + h.net_vec_size);
+
+  ids = (const uint32_t *) (data + h.node_ids);
+  node_values = (const double *) (data + h.node_values);
+  m_topology->nodes.reserve(h.num_nodes);
+  m_topology->node_arena.reserve(h.num_nodes);
+  m_topology->node_values.reserve(h.num_nodes);
+  for (i = 0; i < h.num_nodes; i++) {
+    n = add_node(ids[i]);
+    for (k = 0; k < h.node_vec_size; k++) n->values[k] = node_values[i * h.node_vec_size + k];
+  }
+
+  edge_offsets = (const uint64_t *) (data + h.edge_offsets);
+  edge_to = (const uint32_t *) (data + h.edge_to);
+  edge_values = (const double *) (data + h.edge_values);
+  if (edge_offsets[0] != 0 || edge_offsets[h.num_nodes] != h.num_edges) {
+    throw SRE(estring + "bad edge offsets.");
+  }
+  m_topology->edges.reserve(h.num_edges);
+  m_topology->edge_arena.reserve(h.num_edges);
+  m_topology->edge_values.reserve(h.num_edges);
+  for (i = 0; i < h.num_nodes; i++) {
+    if (edge_offsets[i+1] < edge_offsets[i] || edge_offsets[i+1] > h.num_edges) {
+      throw SRE(estring + "bad edge offsets.");
+    }
+    get_node(ids[i])->outgoing.reserve(edge_offsets[i+1] - edge_offsets[i]);
+    for (k = edge_offsets[i]; k < edge_offsets[i+1]; k++) {
+      if (edge_to[k] >= h.num_nodes) throw SRE(estring + "an edge goes to a node that does not exist.");
+      e = add_edge(ids[i], ids[edge_to[k]]);
+      for (size_t j = 0; j < h.edge_vec_size; j++) e->values[j] = edge_values[k * h.edge_vec_size + j];
+    }
+  }
+
+  io = (const uint32_t *) (data + h.inputs);
+  for (i = 0; i < h.num_inputs; i++) add_input(io[i]);
+  io = (const uint32_t *) (data + h.outputs);
+  for (i = 0; i < h.num_outputs; i++) add_output(io[i]);
+
+  extras = json::parse(data + h.extras[0], data + h.extras[0] + h.extras[1]);
+  if (extras.contains("names")) {
+    for (auto &it : extras["names"].items()) get_node(std::stoul(it.key()))->set_name(it.value());
+  }
+  if (extras.contains("coords")) {
+    for (auto &it : extras["coords"].items()) {
+      get_node(std::stoul(it.key()))->set_coordinates(it.value().get<vector<double>>());
+    }
+  }
+  if (extras.contains("control_points")) {
+    for (auto &cp : extras["control_points"]) {
+      get_edge(cp[0], cp[1])->set_control_point(cp[2].get<vector<double>>());
+    }
+  }
+
+  m_associated_data = json::parse(data + h.associated_data[0],
+                                  data + h.associated_data[0] + h.associated_data[1]);
+}
+
+void Network::network_values_from_json(const json &j)
+{
+    m_topology->properties.from_json(j["Properties"]);
 
     // Add the Network values
 
     values = j["Network_Values"].get<vector <double>>();
-    if (values.size() != m_properties.net_vec_size) {
+    if (values.size() != m_topology->properties.net_vec_size) {
       throw SRE((string) "Error in network JSON: " +
                 "Network_Value's array's size doesn't match the network Propery Pack");
     }
@@ -359,44 +1438,60 @@ void Network::from_json(const json &j)
 
     m_associated_data = json::object();
     if (j["Associated_Data"] != nullptr) m_associated_data = j["Associated_Data"];
+}
 
-    // Add nodes /w values
-    // CHZ I didn't pass as reference because we may need to modify jn
+Node *Network::node_from_json(const json &jn)
+{
+    Node *n;
 
-    for(auto jn : j["Nodes"])
-    {   
-        Parameter_Check_Json_T(jn, node_specs);
-        n = add_node(jn["id"]);
-        n->values = jn["values"].get<vector<double>>();
-        if (n->values.size() != m_properties.node_vec_size) {
-          estring = "Error in the network JSON: Node " + jn["id"].dump() +
-                    "'s value array's size does not match the node PropertyPack";
-          throw SRE(estring);
-        }
-        if (jn.contains("coords")) n->coordinates = jn["coords"].get<vector<double>>();
-        if (jn.contains("name")) n->name = jn["name"];
+    Parameter_Check_Json_T(jn, node_specs);
+    n = add_node(jn["id"]);
+    const json &jv = jn["values"];
+    check_values(n, jv.size());
+    for (size_t i = 0; i < jv.size(); i++) n->values[i] = jv[i].get<double>();
+    if (jn.contains("coords")) n->set_coordinates(jn["coords"].get<vector<double>>());
+    if (jn.contains("name")) n->set_name(jn["name"]);
+    return n;
+}
+
+Edge *Network::edge_from_json(const json &je)
+{
+    Edge *e;
+
+    Parameter_Check_Json_T(je, edge_specs);
+    e = add_edge(je["from"], je["to"]);
+    const json &jv = je["values"];
+    check_values(e, jv.size());
+    for (size_t i = 0; i < jv.size(); i++) e->values[i] = jv[i].get<double>();
+    if (je.contains("control_point")) {
+      e->set_control_point(je["control_point"].get<vector<double>>());
     }
+    return e;
+}
 
-    // Add edges /w values
-    for(auto& je : j["Edges"])
-    {
-        Parameter_Check_Json_T(je, edge_specs);
-        e = add_edge(je["from"], je["to"]);
-        e->values = je["values"].get<vector<double>>();
-        if (e->values.size() != m_properties.edge_vec_size) {
-          estring = "Error in the network JSON: Edge " + je["from"].dump() + "->" +
-                    je["to"].dump() + 
-                    "'s value array's size does not match the edge PropertyPack";
-          throw SRE(estring);
-        }
-        if (je.contains("control_point")) {
-          e->control_point = je["control_point"].get<vector<double>>();
-        }
+void Network::check_values(const Node *n, size_t size) const
+{
+    if (size != m_topology->properties.node_vec_size) {
+      throw SRE("Error in the network JSON: Node " + std::to_string(n->id) +
+                "'s value array's size does not match the node PropertyPack");
     }
+}
 
-    // Set inputs & outputs
+void Network::check_values(const Edge *e, size_t size) const
+{
+    if (size != m_topology->properties.edge_vec_size) {
+      throw SRE("Error in the network JSON: Edge " + std::to_string(e->from->id) + "->" +
+                std::to_string(e->to->id) + 
+                "'s value array's size does not match the edge PropertyPack");
+    }
+}
 
-    // Add the inputs & outputs
+void Network::io_from_json(const json &j)
+{
+    string estring;
+    size_t i;
+    char buf[128];
+    uint32_t id;
 
     for (i = 0; i < j["Inputs"].size(); i++) {
       if (j["Inputs"][i].get<double>() < 0) {
@@ -431,9 +1526,10 @@ Node* Network::add_node(uint32_t idx)
       snprintf(buf, 200, "Node %d already exists at specified index.", idx);
       throw SRE(buf);
     }
+    own();
 
     // insert to hash table & move ownership of pointer
-    std::tie(nit, inserted) = m_nodes.emplace(idx, make_unique<Node>(idx, this));
+    std::tie(nit, inserted) = m_topology->nodes.emplace(idx, NodeMap::mapped_type(new (m_topology->node_arena.allocate()) Node(idx, m_topology.get())));
 
     if (!inserted) {
       snprintf(buf, 200, "Could not insert node %u.", idx);
@@ -441,13 +1537,13 @@ Node* Network::add_node(uint32_t idx)
     }
 
     // Any node addition or deletion invalidates the sorted_node_vector.
-    sorted_node_vector.clear();
+    touch_sorted_index(idx);
 
-    // resize the values vector to match properties
-    nit->second->values.resize(m_properties.node_vec_size);
+    // give it a slot in the value columns
+    m_topology->node_values.add(nit->second.get(), m_topology->properties.node_vec_size);
 
     // set each value to its max in the property pack
-    for (pit = m_properties.nodes.begin(); pit != m_properties.nodes.end(); pit++) {
+    for (pit = m_topology->properties.nodes.begin(); pit != m_topology->properties.nodes.end(); pit++) {
       for (i = 0; i < pit->second.size; i++) {
         nit->second->values[pit->second.index+i] = pit->second.max_value;
       }
@@ -490,7 +1586,7 @@ Edge* Network::add_edge(uint32_t fr, uint32_t to)
     EdgeMap::iterator eit;
     bool inserted;
 
-    std::tie(eit, inserted) = m_edges.emplace(make_pair(fr, to), make_unique<Edge>(from_node, to_node, this));
+    std::tie(eit, inserted) = m_topology->edges.emplace(make_pair(fr, to), EdgeMap::mapped_type(new (m_topology->edge_arena.allocate()) Edge(from_node, to_node, m_topology.get())));
 
     if(!inserted) {
        snprintf(buf, 200, "Could not insert edge %u -> %u", fr, to);
@@ -499,13 +1595,15 @@ Edge* Network::add_edge(uint32_t fr, uint32_t to)
 
     // set the values to their max in the property_pack
 
-    eit->second->values.resize(m_properties.edge_vec_size);
-    for (pit = m_properties.edges.begin(); pit != m_properties.edges.end(); pit++) {
+    m_topology->edge_values.add(eit->second.get(), m_topology->properties.edge_vec_size);
+    for (pit = m_topology->properties.edges.begin(); pit != m_topology->properties.edges.end(); pit++) {
       for (i = 0; i < pit->second.size; i++) {
         eit->second->values[pit->second.index+i] = pit->second.max_value;
       }
     }
 
+    eit->second->out_index = from_node->outgoing.size();
+    eit->second->in_index = to_node->incoming.size();
     from_node->outgoing.push_back(eit->second.get());
     to_node->incoming.push_back(eit->second.get());
 
@@ -546,13 +1644,14 @@ void Network::rename_node(uint32_t old_name, uint32_t new_name)
       throw SRE(buf);
     }
 
-    std::tie(nit, inserted) = m_nodes.emplace(new_name, std::move(m_nodes.at(old_name)));
+    std::tie(nit, inserted) = m_topology->nodes.emplace(new_name, std::move(m_topology->nodes.at(old_name)));
     
     // Any node addition or deletion invalidates the sorted_node_vector.
-    sorted_node_vector.clear();
+    touch_sorted_index(old_name);
+    touch_sorted_index(new_name);
    
     n = nit->second.get(); // we must get the node before we call erase otherwise we may lose it.
-    m_nodes.erase(old_name);
+    m_topology->nodes.erase(old_name);
     n->id = new_name;
    
     // Move edges
@@ -565,8 +1664,8 @@ void Network::rename_node(uint32_t old_name, uint32_t new_name)
         if (fr_idx == new_name) fr_idx = old_name; // self-loop case
         auto old_edge_name = make_pair(fr_idx, old_name);
          
-        m_edges.emplace(new_edge_name, std::move(m_edges.at(old_edge_name)));
-        m_edges.erase(old_edge_name);
+        m_topology->edges.emplace(new_edge_name, std::move(m_topology->edges.at(old_edge_name)));
+        m_topology->edges.erase(old_edge_name);
          
        
     }
@@ -577,10 +1676,10 @@ void Network::rename_node(uint32_t old_name, uint32_t new_name)
         auto to_idx = e->to->id;
         auto old_edge_name = make_pair(old_name, to_idx);
         auto new_edge_name = make_pair(new_name, to_idx);
-        if (to_idx != new_name) // self-loop edge only has one instance in m_edges.
+        if (to_idx != new_name) // self-loop edge only has one instance in m_topology->edges.
         {
-            m_edges.emplace(new_edge_name, std::move(m_edges.at(old_edge_name)));
-            m_edges.erase(old_edge_name);
+            m_topology->edges.emplace(new_edge_name, std::move(m_topology->edges.at(old_edge_name)));
+            m_topology->edges.erase(old_edge_name);
         }
     
     }
@@ -591,20 +1690,29 @@ void Network::rename_node(uint32_t old_name, uint32_t new_name)
 
 bool Network::is_node(uint32_t idx) const
 {
-    return (m_nodes.find(idx) != m_nodes.end());
+    return (m_topology->nodes.find(idx) != m_topology->nodes.end());
 }
 
 bool Network::is_edge(uint32_t fr, uint32_t to) const
 {
-    return (m_edges.find(make_pair(fr, to)) != m_edges.end());
+    return (m_topology->edges.find(make_pair(fr, to)) != m_topology->edges.end());
+}
+
+Node* Network::get_node(uint32_t idx)
+{
+    const Node *n = static_cast<const Network *>(this)->get_node(idx);
+
+    // A clone has the node in the same slot.
+    if (m_topology.use_count() != 1) n = own().node_values.owners[n->values.slot];
+    return const_cast<Node *>(n);
 }
 
-Node* Network::get_node(uint32_t idx) const
+const Node* Network::get_node(uint32_t idx) const
 {
     char buf[100];
-    auto n = m_nodes.find(idx);
+    auto n = m_topology->nodes.find(idx);
 
-    if (n == m_nodes.end()) {
+    if (n == m_topology->nodes.end()) {
       snprintf(buf, 100, "Node %u does not exist.", idx);
       throw SRE((string) buf);
     }
@@ -612,12 +1720,20 @@ Node* Network::get_node(uint32_t idx) const
     return n->second.get();
 }
 
-Edge* Network::get_edge(uint32_t fr, uint32_t to) const
+Edge* Network::get_edge(uint32_t fr, uint32_t to)
+{
+    const Edge *e = static_cast<const Network *>(this)->get_edge(fr, to);
+
+    if (m_topology.use_count() != 1) e = own().edge_values.owners[e->values.slot];
+    return const_cast<Edge *>(e);
+}
+
+const Edge* Network::get_edge(uint32_t fr, uint32_t to) const
 {
     char buf[100];
-    auto e = m_edges.find(make_pair(fr, to));
+    auto e = m_topology->edges.find(make_pair(fr, to));
 
-    if (e == m_edges.end()) {
+    if (e == m_topology->edges.end()) {
       snprintf(buf, 100, "Edge %u -> %u does not exist.", fr, to);
       throw SRE((string) buf);
     }
@@ -640,27 +1756,24 @@ void Network::remove_node(uint32_t idx, bool force)
     }
 
     // Any node addition or deletion invalidates the sorted_node_vector.
-    sorted_node_vector.clear();
+    touch_sorted_index(idx);
    
     // Remove all synapses to/from this node
     // Note: we just need to remove references to these edges & then remove from the hash table
     // This node's incoming/outgoing vector can be deallocated all together rather than per-edge
+    // Each edge knows its position in the other node's vector, so this is O(degree).
     for(auto e : n->incoming)
     {
         Node *from_node = e->from;
-        auto f_edge = std::find(from_node->outgoing.begin(), from_node->outgoing.end(), e);
-        std::iter_swap(f_edge, from_node->outgoing.end() - 1);
-        from_node->outgoing.pop_back();
-        m_edges.erase(make_pair(from_node->id, idx));
+        unlink_edge(e, true);
+        m_topology->edges.erase(make_pair(from_node->id, idx));
     }
 
     for(auto e : n->outgoing)
     {
         Node *to_node = e->to;
-        auto t_edge = std::find(to_node->incoming.begin(), to_node->incoming.end(), e);
-        std::iter_swap(t_edge, to_node->incoming.end() - 1);
-        to_node->incoming.pop_back();
-        m_edges.erase(make_pair(idx, to_node->id));
+        unlink_edge(e, false);
+        m_topology->edges.erase(make_pair(idx, to_node->id));
     }
 
     if(n->input_id >= 0)
@@ -670,30 +1783,19 @@ void Network::remove_node(uint32_t idx, bool force)
         m_outputs[n->output_id] = -1;
 
     // hash table owns the pointer, so this also deconstructs the node
-    m_nodes.erase(idx);
+    m_topology->nodes.erase(idx);
 }
 
 void Network::remove_edge(uint32_t fr, uint32_t to)
 {
     Edge* e = get_edge(fr, to);
-    Node* from_node = get_node(fr);
-    Node* to_node = get_node(to);
-
-    // get location in node-level vectors
-    auto f_edge = std::find(from_node->outgoing.begin(), from_node->outgoing.end(), e);
-    auto t_edge = std::find(to_node->incoming.begin(), to_node->incoming.end(), e);
-
-    // TODO: check find to see if it was found or not
 
-    // swap to end & pop
-    std::iter_swap(f_edge, from_node->outgoing.end() - 1);
-    from_node->outgoing.pop_back();
-
-    std::iter_swap(t_edge, to_node->incoming.end() - 1);
-    to_node->incoming.pop_back();
+    // swap to end & pop, using the edge's positions in the node-level vectors
+    unlink_edge(e, true);
+    unlink_edge(e, false);
 
     // removal from hash table must be the last operation
-    m_edges.erase(make_pair(fr, to));
+    m_topology->edges.erase(make_pair(fr, to));
 }
 
 int Network::add_input(uint32_t idx)
@@ -724,7 +1826,13 @@ int Network::add_output(uint32_t idx)
     return n->output_id;
 }
 
-Node* Network::get_input(int input_id) const
+Node* Network::get_input(int input_id)
+{
+    static_cast<const Network *>(this)->get_input(input_id);
+    return get_node(m_inputs[input_id]);
+}
+
+const Node* Network::get_input(int input_id) const
 {
     char buf[48];
     int node_id = m_inputs.at(input_id);
@@ -735,7 +1843,13 @@ Node* Network::get_input(int input_id) const
     return get_node(node_id);
 }
 
-Node* Network::get_output(int output_id) const
+Node* Network::get_output(int output_id)
+{
+    static_cast<const Network *>(this)->get_output(output_id);
+    return get_node(m_outputs[output_id]);
+}
+
+const Node* Network::get_output(int output_id) const
 {
     char buf[48];
     int node_id = m_outputs.at(output_id);
@@ -758,41 +1872,135 @@ int Network::num_outputs() const
 
 NodeMap::iterator Network::begin()
 {
-    return m_nodes.begin();
+    return own().nodes.begin();
 }
 
 NodeMap::iterator Network::end()
 {
-    return m_nodes.end();
+    return own().nodes.end();
+}
+
+NodeMap::const_iterator Network::begin() const
+{
+    return m_topology->nodes.begin();
+}
+
+NodeMap::const_iterator Network::end() const
+{
+    return m_topology->nodes.end();
 }
 
 EdgeMap::iterator Network::edges_begin()
 {
-    return m_edges.begin();
+    return own().edges.begin();
 }
 
 EdgeMap::iterator Network::edges_end()
 {
-    return m_edges.end();
+    return own().edges.end();
+}
+
+EdgeMap::const_iterator Network::edges_begin() const
+{
+    return m_topology->edges.begin();
+}
+
+EdgeMap::const_iterator Network::edges_end() const
+{
+    return m_topology->edges.end();
 }
 
 void Network::make_sorted_node_vector()
 {
   NodeMap::iterator nit;
+  vector <uint32_t> ids;
+  size_t i, j;
+  uint32_t id;
 
   if (sorted_node_vector.size() != 0) return;
-  for (nit = begin(); nit != end(); nit++) sorted_node_vector.push_back(nit->second.get());
-  sort(sorted_node_vector.begin(), sorted_node_vector.end(), node_comp);
+
+  /* If there's no index, or someone has been editing sorted_node_vector,
+     do the full sort. */
+
+  if (!m_sorted_valid || m_sorted_base.size() != m_sorted_ids.size()) {
+    clear_sorted_index();
+    sorted_node_vector.reserve(m_topology->nodes.size());
+    for (nit = m_topology->nodes.begin(); nit != m_topology->nodes.end(); nit++) sorted_node_vector.push_back(nit->second.get());
+    sort(sorted_node_vector.begin(), sorted_node_vector.end(), node_comp);
+    m_sorted_ids.reserve(sorted_node_vector.size());
+    for (i = 0; i < sorted_node_vector.size(); i++) m_sorted_ids.push_back(sorted_node_vector[i]->id);
+    m_sorted_valid = true;
+    return;
+  }
+
+  /* Otherwise, merge the pending ids into the old vector.  An old entry whose
+     id is pending is dropped without looking at it -- the node may have been
+     removed.  A pending id goes in if it's a node now. */
+
+  sort(m_sorted_pending.begin(), m_sorted_pending.end());
+  m_sorted_pending.erase(unique(m_sorted_pending.begin(), m_sorted_pending.end()),
+                         m_sorted_pending.end());
+
+  sorted_node_vector.reserve(m_topology->nodes.size());
+  ids.reserve(m_topology->nodes.size());
+  i = 0;
+  j = 0;
+  while (i < m_sorted_base.size() || j < m_sorted_pending.size()) {
+    if (j == m_sorted_pending.size() || 
+        (i < m_sorted_base.size() && m_sorted_ids[i] < m_sorted_pending[j])) {
+      sorted_node_vector.push_back(m_sorted_base[i]);
+      ids.push_back(m_sorted_ids[i]);
+      i++;
+    } else {
+      id = m_sorted_pending[j];
+      if (i < m_sorted_base.size() && m_sorted_ids[i] == id) i++;
+      nit = m_topology->nodes.find(id);
+      if (nit != m_topology->nodes.end()) {
+        sorted_node_vector.push_back(nit->second.get());
+        ids.push_back(id);
+      }
+      j++;
+    }
+  }
+
+  m_sorted_ids.swap(ids);
+  m_sorted_base.clear();
+  m_sorted_pending.clear();
+}
+
+void Network::touch_sorted_index(uint32_t id)
+{
+  /* Empty sorted_node_vector in O(1), keeping its contents for the merge. */
+
+  if (sorted_node_vector.size() != 0) {
+    m_sorted_base.clear();
+    m_sorted_base.swap(sorted_node_vector);
+  }
+  if (!m_sorted_valid) return;
+
+  /* Once the pending ids outnumber the nodes, a full sort is just as good. */
+
+  m_sorted_pending.push_back(id);
+  if (m_sorted_pending.size() > m_topology->nodes.size() + 64) clear_sorted_index();
+}
+
+void Network::clear_sorted_index()
+{
+  sorted_node_vector.clear();
+  vector <Node *>().swap(m_sorted_base);
+  vector <uint32_t>().swap(m_sorted_ids);
+  vector <uint32_t>().swap(m_sorted_pending);
+  m_sorted_valid = false;
 }
 
 size_t Network::num_nodes() const
 {
-    return m_nodes.size();
+    return m_topology->nodes.size();
 }
 
 size_t Network::num_edges() const
 {
-    return m_edges.size();
+    return m_topology->edges.size();
 }
 
 void Network::set_data(const string& name, const json& data)
@@ -821,28 +2029,54 @@ vector<string> Network::data_keys() const
     return keys;
 }
 
-Node* Network::get_random_node(MOA& moa) const
+/* The value columns already keep a dense array of the nodes and edges, which add and
+   remove maintain by swapping with the last slot, so these are O(1).  Each call takes
+   one Random_Integer() from the MOA and uses it as a slot.  So a seed and a sequence of
+   changes to the network always give the same picks, but they aren't the picks that
+   walking the hash table gave, before this. */
+
+Node* Network::get_random_node(MOA& moa)
+{
+    if (m_topology->node_values.owners.empty()) throw SRE("Network::get_random_node() - the network has no nodes.");
+    own();
+    return m_topology->node_values.owners[moa.Random_Integer() % m_topology->node_values.owners.size()];
+}
+
+const Node* Network::get_random_node(MOA& moa) const
+{
+    if (m_topology->node_values.owners.empty()) throw SRE("Network::get_random_node() - the network has no nodes.");
+    return m_topology->node_values.owners[moa.Random_Integer() % m_topology->node_values.owners.size()];
+}
+
+Edge* Network::get_random_edge(MOA& moa)
+{
+    if (m_topology->edge_values.owners.empty()) throw SRE("Network::get_random_edge() - the network has no edges.");
+    own();
+    return m_topology->edge_values.owners[moa.Random_Integer() % m_topology->edge_values.owners.size()];
+}
+
+const Edge* Network::get_random_edge(MOA& moa) const
 {
-    // TODO: Make this good
-    auto it = m_nodes.begin();
-    std::advance(it, moa.Random_Integer() % num_nodes());
-    return it->second.get();
+    if (m_topology->edge_values.owners.empty()) throw SRE("Network::get_random_edge() - the network has no edges.");
+    return m_topology->edge_values.owners[moa.Random_Integer() % m_topology->edge_values.owners.size()];
 }
 
-Edge* Network::get_random_edge(MOA& moa) const
+Node* Network::get_random_input(MOA& moa)
 {
-    // TODO: Make this good
-    auto it = m_edges.begin();
-    std::advance(it, moa.Random_Integer() % num_edges());
-    return it->second.get();
+    return get_input(moa.Random_Integer() % num_inputs());
 }
 
-Node* Network::get_random_input(MOA& moa) const
+const Node* Network::get_random_input(MOA& moa) const
 {
     return get_input(moa.Random_Integer() % num_inputs());
 }
 
-Node* Network::get_random_output(MOA& moa) const
+Node* Network::get_random_output(MOA& moa)
+{
+    return get_output(moa.Random_Integer() % num_outputs());
+}
+
+const Node* Network::get_random_output(MOA& moa) const
 {
     return get_output(moa.Random_Integer() % num_outputs());
 }
@@ -870,101 +2104,268 @@ double Network::random_value(MOA& moa, const Property& p)
     return rv;
 }
 
-void Network::randomize(const json& params)
+/* The random networks.  Nodes 0 through inputs-1 are the inputs, the next ones are the
+   outputs, and the hidden nodes come after them.  Each generator makes a list of edges
+   first, so that random_edges() can reserve room for all of them at once. */
+
+static size_t random_count(const json &params, const string &key, size_t def)
 {
-    (void) params;
-    // TODO
-    //   Allow this function to be a front-end for a family of functions
-    throw std::logic_error("Random network generation is not yet implemented.");
+    if (!params.contains(key)) return def;
+    if (!params[key].is_number_integer() || params[key].get<int64_t>() < 0) {
+        throw SRE("Network::randomize() - \"" + key + "\" must be an integer >= 0.");
+    }
+    return params[key].get<size_t>();
 }
 
-void Network::randomize_p(const json& params)
+static double random_probability(const json &params, const string &key, double def)
 {
-    (void) params;
-    // TODO
-    //   Add n hidden nodes
-    //   Connect nodes with probability p
-    throw std::logic_error("Random network generation is not yet implemented.");
+    double p;
+
+    if (!params.contains(key)) return def;
+    if (!params[key].is_number()) {
+        throw SRE("Network::randomize() - \"" + key + "\" must be a number.");
+    }
+    p = params[key];
+    if (!(p >= 0 && p <= 1)) {
+        throw SRE("Network::randomize() - \"" + key + "\" must be between 0 and 1.");
+    }
+    return p;
 }
 
-void Network::randomize_h(const json& params)
+/* Edges from the fn nodes starting at fb to the tn nodes starting at tb, each with
+   probability p.  Instead of rolling for every pair, we roll the gap to the next edge,
+   which is geometric, so the time is linear in the edges rather than the pairs. */
+
+static void random_pairs(MOA &moa, double p, uint32_t fb, uint32_t fn, uint32_t tb, uint32_t tn,
+                         bool self_loops, vector < pair <uint32_t, uint32_t> > &edges)
 {
-    (void) params;
-    // TODO
-    //   Add n hidden nodes
-    //   Randomly connect input -> hidden,
-    //                    hidden -> hidden,
-    //                    hidden -> output
-    throw std::logic_error("Random network generation is not yet implemented.");
+    double total, k, lq;
+    uint64_t i;
+    uint32_t from, to;
+
+    total = (double) fn * tn;
+    if (p == 0 || total == 0) return;
+
+    if (p == 1) {
+        for (from = fb; from < fb + fn; from++) {
+            for (to = tb; to < tb + tn; to++) {
+                if (self_loops || from != to) edges.push_back(make_pair(from, to));
+            }
+        }
+        return;
+    }
+
+    lq = log(1 - p);
+    k = -1;
+    while (true) {
+        k += 1 + floor(log(1 - moa.Random_Double()) / lq);
+        if (k >= total) return;
+        i = (uint64_t) k;
+        from = fb + i / tn;
+        to = tb + i % tn;
+        if (self_loops || from != to) edges.push_back(make_pair(from, to));
+    }
 }
 
-void Network::prune()
+void Network::random_nodes(MOA &moa, const json& params)
 {
-    // search state information
-    tsl::robin_set<uint32_t> visited;
-    std::vector<uint32_t> to_remove;
+    size_t ni, no, nh, nn, i;
+    json data;
 
-    // DFS lambdas
-    std::function<void(Node*)> traverse_inputs;
-    std::function<void(Node*)> traverse_outputs;
+    ni = random_count(params, "inputs", 0);
+    no = random_count(params, "outputs", 0);
+    nh = random_count(params, "hidden", 0);
+    nn = ni + no + nh;
+    if (nn > 0xffffffffULL) throw SRE("Network::randomize() - too many nodes.");
 
-    // Any node addition or deletion invalidates the sorted_node_vector.
-    // We'll lump prune in here.
-    sorted_node_vector.clear();
-   
-    traverse_inputs = [&traverse_inputs, &visited](Node *n) {
-        // check if node has been visited
-        auto it = visited.find(n->id);
-        if(it == visited.end())
-        {
-            // mark as visited
-            visited.insert(n->id);
+    /* The associated data stays, so that the processor's params go with the network. */
+
+    data.swap(m_associated_data);
+    clear(false);
+    m_associated_data.swap(data);
+    randomize_properties(moa);
+    m_topology->nodes.reserve(nn);
+    m_topology->node_arena.reserve(nn);
+    m_topology->node_values.reserve(nn);
+    for (i = 0; i < nn; i++) randomize_properties(moa, add_node(i));
+    for (i = 0; i < ni; i++) add_input(i);
+    for (i = 0; i < no; i++) add_output(ni + i);
+}
+
+void Network::random_edges(MOA &moa, const vector < pair <uint32_t, uint32_t> > &edges)
+{
+    size_t i;
+
+    own().edges.reserve(edges.size());
+    m_topology->edge_arena.reserve(edges.size());
+    m_topology->edge_values.reserve(edges.size());
+    for (i = 0; i < edges.size(); i++) {
+        randomize_properties(moa, add_edge(edges[i].first, edges[i].second));
+    }
+}
+
+void Network::randomize(const json& params)
+{
+    MOA moa;
+    uint32_t seed;
+
+    seed = random_count(params, "seed", 0);
+    moa.Seed(seed, "randomize");
+    randomize(moa, params);
+}
+
+void Network::randomize(MOA &moa, const json& params)
+{
+    string type;
+
+    if (!params.is_object() || !params.contains("type") || !params["type"].is_string()) {
+        throw SRE("Network::randomize() - params must be a json object with a \"type\" string.");
+    }
+    type = params["type"];
+    if (type == "erdos_renyi") {
+        randomize_p(moa, params);
+    } else if (type == "layered") {
+        randomize_h(moa, params);
+    } else if (type == "small_world") {
+        randomize_w(moa, params);
+    } else {
+        throw SRE("Network::randomize() - type must be erdos_renyi, layered or small_world.");
+    }
+}
 
-            // traverse all incoming edges
-            for(Edge *e : n->incoming)
-                traverse_inputs(e->from);
+/* Every ordered pair of nodes gets an edge with probability p. */
+
+void Network::randomize_p(MOA &moa, const json& params)
+{
+    vector < pair <uint32_t, uint32_t> > edges;
+    double p;
+    bool self_loops;
+
+    if (!params.contains("p")) throw SRE("Network::randomize() - erdos_renyi needs \"p\".");
+    p = random_probability(params, "p", 0);
+    self_loops = false;
+    if (params.contains("self_loops")) {
+        if (!params["self_loops"].is_boolean()) {
+            throw SRE("Network::randomize() - \"self_loops\" must be true or false.");
         }
-    };
+        self_loops = params["self_loops"];
+    }
 
-    traverse_outputs = [&traverse_outputs, &visited](Node *n) {
-        // check if node has been visited
-        auto it = visited.find(n->id);
-        if(it == visited.end())
-        {
-            // mark as visited
-            visited.insert(n->id);
+    random_nodes(moa, params);
+    random_pairs(moa, p, 0, num_nodes(), 0, num_nodes(), self_loops, edges);
+    random_edges(moa, edges);
+}
+
+/* The hidden nodes are split into layers, as evenly as they go.  Each node has an edge
+   to each node of the next layer with probability p, and to each other node of its own
+   hidden layer with probability recurrent_p. */
+
+void Network::randomize_h(MOA &moa, const json& params)
+{
+    vector < pair <uint32_t, uint32_t> > edges;
+    vector <uint32_t> base, size;
+    size_t ni, no, nh, nl, i;
+    double p, rp;
+
+    ni = random_count(params, "inputs", 0);
+    no = random_count(params, "outputs", 0);
+    nh = random_count(params, "hidden", 0);
+    nl = random_count(params, "layers", 1);
+    p = random_probability(params, "p", 1);
+    rp = random_probability(params, "recurrent_p", 0);
+    if (nh == 0) nl = 0;
+    if (nl > nh) throw SRE("Network::randomize() - more layers than hidden nodes.");
+
+    random_nodes(moa, params);
+
+    base.push_back(0);
+    size.push_back(ni);
+    for (i = 0; i < nl; i++) {
+        base.push_back((i == 0) ? ni + no : base.back() + size.back());
+        size.push_back(nh / nl + ((i < nh % nl) ? 1 : 0));
+    }
+    base.push_back(ni);
+    size.push_back(no);
+
+    for (i = 0; i + 1 < base.size(); i++) {
+        random_pairs(moa, p, base[i], size[i], base[i+1], size[i+1], false, edges);
+        if (i > 0) random_pairs(moa, rp, base[i], size[i], base[i], size[i], false, edges);
+    }
+    random_edges(moa, edges);
+}
+
+/* Small world (Watts-Strogatz): the nodes sit on a ring in id order, and each has edges
+   to the k nodes on either side of it.  Then each edge is rewired to a random node with
+   probability beta, avoiding self-loops and duplicates. */
+
+void Network::randomize_w(MOA &moa, const json& params)
+{
+    vector < pair <uint32_t, uint32_t> > edges;
+    vector <uint32_t> to;
+    size_t nn, k, i, j;
+    double beta;
+    uint32_t t;
+
+    nn = random_count(params, "inputs", 0) + random_count(params, "outputs", 0) +
+         random_count(params, "hidden", 0);
+    k = random_count(params, "k", 2);
+    beta = random_probability(params, "beta", 0.1);
+    if (nn > 0 && 2 * k >= nn) {
+        throw SRE("Network::randomize() - small_world needs 2k to be less than the number of nodes.");
+    }
+
+    random_nodes(moa, params);
+    edges.reserve(2 * k * nn);
 
-            // traverse all outgoing edges
-            for(Edge *e : n->outgoing)
-                traverse_outputs(e->to);
+    for (i = 0; i < nn; i++) {
+        to.clear();
+        for (j = 1; j <= k; j++) {
+            to.push_back((i + j) % nn);
+            to.push_back((i + nn - j) % nn);
         }
-    };
+        for (j = 0; j < to.size(); j++) {
+            if (to.size() + 1 >= nn || moa.Random_Double() >= beta) continue;
+            do {
+                t = moa.Random_64() % nn;
+            } while (t == i || std::find(to.begin(), to.end(), t) != to.end());
+            to[j] = t;
+        }
+        for (j = 0; j < to.size(); j++) edges.push_back(make_pair(i, to[j]));
+    }
+    random_edges(moa, edges);
+}
+
+void Network::prune()
+{
+    std::vector<uint32_t> to_remove;
+    vector<bool> from_inputs, to_outputs;
+
+    // Any node addition or deletion invalidates the sorted_node_vector.
+    // Prune goes through remove_node(), which takes care of that.
 
-    // Traverse from each input
-    for(auto c : m_inputs) traverse_outputs(m_nodes.at(c).get());
+    // The graph's searches are iterative, so long chains can't overflow the stack.
+    // Delays don't matter here, hence the empty delay property.
+    NetworkGraph g(this, "");
+    from_inputs = g.from_inputs();
+    to_outputs = g.to_outputs();
 
-    // Check which nodes were visited
-    for(auto& elm : m_nodes)
-        if(visited.find(elm.first) == visited.end() && (elm.second->is_hidden()))
+    // Remove hidden nodes which can't be reached from an input
+    for(auto& elm : m_topology->nodes)
+        if(!from_inputs[g.index(elm.first)] && (elm.second->is_hidden()))
             to_remove.emplace_back(elm.first);
     
-    // Remove nodes which weren't visited
     for(auto c : to_remove)
         remove_node(c, false);
 
-    // Clear state
-    visited.clear();
     to_remove.clear();
 
-    // Traverse from each output
-    for(auto c : m_outputs) traverse_inputs(m_nodes.at(c).get());
-
-    // Check which nodes were visited
-    for(auto& elm : m_nodes)
-        if(visited.find(elm.first) == visited.end() && (elm.second->is_hidden()))
+    // Then the ones which can't reach an output.  The first removals don't change this
+    // for the nodes that are left, since a path from them to an output only goes
+    // through nodes that are reachable from an input too.
+    for(auto& elm : m_topology->nodes)
+        if(!to_outputs[g.index(elm.first)] && (elm.second->is_hidden()))
             to_remove.emplace_back(elm.first);
 
-    // Remove nodes which weren't visited
     for(auto c : to_remove)
         remove_node(c, false);
 }
@@ -975,10 +2376,16 @@ void Network::randomize_property(MOA& moa, const Property& p, vector<double>& pv
         pv[i] = random_value(moa, p);
 }
 
+void Network::randomize_property(MOA& moa, const Property& p, ValueRow& pv)
+{
+    for(auto i = p.index; i < p.index + p.size; i++)
+        pv[i] = random_value(moa, p);
+}
+
 void Network::randomize_property(MOA& moa, Node *n, const string& pname)
 {
-    auto pit = m_properties.nodes.find(pname);
-    if (pit == std::end(m_properties.nodes)) {
+    auto pit = m_topology->properties.nodes.find(pname);
+    if (pit == std::end(m_topology->properties.nodes)) {
       throw SRE((string) "Cannot randomize node property '" + pname + "'"); 
     }
     randomize_property(moa, pit->second, n->values);
@@ -986,8 +2393,8 @@ void Network::randomize_property(MOA& moa, Node *n, const string& pname)
 
 void Network::randomize_property(MOA& moa, Edge *e, const string& pname)
 {
-    auto pit = m_properties.edges.find(pname);
-    if(pit == std::end(m_properties.edges))  {
+    auto pit = m_topology->properties.edges.find(pname);
+    if(pit == std::end(m_topology->properties.edges))  {
       throw SRE((string) "Cannot randomize edge property '" + pname + "'"); 
     }
     randomize_property(moa, pit->second, e->values);
@@ -995,8 +2402,8 @@ void Network::randomize_property(MOA& moa, Edge *e, const string& pname)
 
 void Network::randomize_property(MOA& moa, const string& pname)
 {
-    auto pit = m_properties.networks.find(pname);
-    if(pit == std::end(m_properties.networks)) {
+    auto pit = m_topology->properties.networks.find(pname);
+    if(pit == std::end(m_topology->properties.networks)) {
       throw SRE((string) "Cannot randomize network property '" + pname + "'"); 
     }
     randomize_property(moa, pit->second, values);
@@ -1004,41 +2411,41 @@ void Network::randomize_property(MOA& moa, const string& pname)
 
 void Network::randomize_properties(MOA &moa)
 {
-    for(auto &p : m_properties.networks)
+    for(auto &p : m_topology->properties.networks)
         randomize_property(moa, p.second, values);
 }
 
 void Network::randomize_properties(MOA &moa, Node *n)
 {
-    for(auto &p : m_properties.nodes)
+    for(auto &p : m_topology->properties.nodes)
         randomize_property(moa, p.second, n->values);
 }
 
 void Network::randomize_properties(MOA &moa, Edge *e)
 {
-    for(auto &p : m_properties.edges)
+    for(auto &p : m_topology->properties.edges)
         randomize_property(moa, p.second, e->values);
 }
 
 bool Network::is_node_property(const string& name) const
 {
-    return(m_properties.nodes.find(name) != m_properties.nodes.end());
+    return(m_topology->properties.nodes.find(name) != m_topology->properties.nodes.end());
 }
 
 bool Network::is_edge_property(const string& name) const
 {
-    return(m_properties.edges.find(name) != m_properties.edges.end());
+    return(m_topology->properties.edges.find(name) != m_topology->properties.edges.end());
 }
 
 bool Network::is_network_property(const string& name) const
 {
-    return(m_properties.networks.find(name) != m_properties.networks.end());
+    return(m_topology->properties.networks.find(name) != m_topology->properties.networks.end());
 }
 
 const Property* Network::get_node_property(const string& name) const
 {
-    auto mit = m_properties.nodes.find(name);
-    if (mit == m_properties.nodes.end()) {
+    auto mit = m_topology->properties.nodes.find(name);
+    if (mit == m_topology->properties.nodes.end()) {
       throw SRE((string) "Cannot find node property: " + name);
     }
     return &(mit->second);
@@ -1046,8 +2453,8 @@ const Property* Network::get_node_property(const string& name) const
 
 const Property* Network::get_edge_property(const string& name) const
 {
-    auto mit = m_properties.edges.find(name);
-    if (mit == m_properties.edges.end()) {
+    auto mit = m_topology->properties.edges.find(name);
+    if (mit == m_topology->properties.edges.end()) {
       throw SRE((string) "Cannot find edge property: " + name);
     }
     return &(mit->second);
@@ -1055,16 +2462,68 @@ const Property* Network::get_edge_property(const string& name) const
 
 const Property* Network::get_network_property(const string& name) const
 {
-    auto mit = m_properties.networks.find(name);
-    if(mit == m_properties.networks.end()) {
+    auto mit = m_topology->properties.networks.find(name);
+    if(mit == m_topology->properties.networks.end()) {
       throw SRE((string) "Cannot find network property: " + name);
     }
     return &(mit->second);
 }
 
+ValueSpan Network::node_column(const string& name, int k)
+{
+    const Property *p;
+
+    p = get_node_property(name);
+    if (k < 0 || k >= p->size) {
+      throw SRE("Node property " + name + " has no value " + std::to_string(k));
+    }
+    if (m_topology->node_values.owners.empty()) return ValueSpan();
+    return ValueSpan(own().node_values.own_column(p->index + k), m_topology->node_values.owners.size());
+}
+
+ValueSpan Network::edge_column(const string& name, int k)
+{
+    const Property *p;
+
+    p = get_edge_property(name);
+    if (k < 0 || k >= p->size) {
+      throw SRE("Edge property " + name + " has no value " + std::to_string(k));
+    }
+    if (m_topology->edge_values.owners.empty()) return ValueSpan();
+    return ValueSpan(own().edge_values.own_column(p->index + k), m_topology->edge_values.owners.size());
+}
+
+Node* Network::column_node(size_t slot)
+{
+    static_cast<const Network *>(this)->column_node(slot);
+    return own().node_values.owners[slot];
+}
+
+const Node* Network::column_node(size_t slot) const
+{
+    if (slot >= m_topology->node_values.owners.size()) {
+      throw SRE("Network::column_node(): slot " + std::to_string(slot) + " is out of range");
+    }
+    return m_topology->node_values.owners[slot];
+}
+
+Edge* Network::column_edge(size_t slot)
+{
+    static_cast<const Network *>(this)->column_edge(slot);
+    return own().edge_values.owners[slot];
+}
+
+const Edge* Network::column_edge(size_t slot) const
+{
+    if (slot >= m_topology->edge_values.owners.size()) {
+      throw SRE("Network::column_edge(): slot " + std::to_string(slot) + " is out of range");
+    }
+    return m_topology->edge_values.owners[slot];
+}
+
 PropertyPack Network::get_properties() const
 {
-    return m_properties;
+    return m_topology->properties;
 }
 
 void Network::set_properties(const PropertyPack& pp)
@@ -1072,77 +2531,139 @@ void Network::set_properties(const PropertyPack& pp)
     PropertyMap::const_iterator pit;
     int i;
 
-    if(!m_nodes.empty() || !m_edges.empty()) 
+    if(!m_topology->nodes.empty() || !m_topology->edges.empty()) 
         throw std::runtime_error("Cannot add properties after the network has elements.");
 
-    m_properties = pp;
+    own().properties = pp;
 
     /* Create the values vector and set each element to its max in the property pack */
 
-    values.resize(m_properties.net_vec_size);
-    for (pit = m_properties.networks.begin(); pit != m_properties.networks.end(); pit++) {
+    values.resize(m_topology->properties.net_vec_size);
+    for (pit = m_topology->properties.networks.begin(); pit != m_topology->properties.networks.end(); pit++) {
       for (i = 0; i < pit->second.size; i++) {
         values[pit->second.index+i] = pit->second.max_value;
       }
     }
 }
 
-string Network::pretty_nodes() const
+/* The streaming writer.  These write exactly what dump() would write for the
+   json of a node or edge, without making the json. */
+
+static void write_double(std::ostream &out, double v)
+{
+  char buf[64];
+  char *end;
+
+  if (!std::isfinite(v)) {
+    out << "null";
+    return;
+  }
+  end = nlohmann::detail::to_chars(buf, buf + sizeof(buf), v);
+  out.write(buf, end - buf);
+}
+
+template <class V>
+static void write_doubles(std::ostream &out, const V &v)
+{
+  size_t i;
+
+  out.put('[');
+  for (i = 0; i < v.size(); i++) {
+    if (i != 0) out.put(',');
+    write_double(out, v[i]);
+  }
+  out.put(']');
+}
+
+template <class V>
+static void write_ids(std::ostream &out, const V &v)
+{
+  size_t i;
+
+  out.put('[');
+  for (i = 0; i < v.size(); i++) {
+    if (i != 0) out.put(',');
+    out << v[i];
+  }
+  out.put(']');
+}
+
+static void write_node(std::ostream &out, const Node *n)
+{
+  out.put('{');
+  if (n->get_coordinates().size() != 0) {
+    out << "\"coords\":";
+    write_doubles(out, n->get_coordinates());
+    out.put(',');
+  }
+  out << "\"id\":" << n->id;
+  if (n->get_name() != "") out << ",\"name\":" << json(n->get_name()).dump();
+  out << ",\"values\":";
+  write_doubles(out, n->values);
+  out.put('}');
+}
+
+static void write_edge(std::ostream &out, const Edge *e)
+{
+  out.put('{');
+  if (e->get_control_point().size() != 0) {
+    out << "\"control_point\":";
+    write_doubles(out, e->get_control_point());
+    out.put(',');
+  }
+  out << "\"from\":" << e->from->id << ",\"to\":" << e->to->id << ",\"values\":";
+  write_doubles(out, e->values);
+  out.put('}');
+}
+
+/* One node per line, each line starting with indent. */
+
+void Network::write_nodes(std::ostream &out, const string &indent) const
 {
   size_t i;
-  string s;
   bool use_vector;
   NodeMap::const_iterator nit;
 
-  if (m_nodes.size() == 0) return "[]";
-  
+  if (m_topology->nodes.size() == 0) {
+    out << indent << "[]";
+    return;
+  }
+
   use_vector = (sorted_node_vector.size() != 0);
 
-  nit = m_nodes.begin();
-  s = "";
-  for (i = 0; i < m_nodes.size(); i++) {
-    s += ((i == 0) ? "[ " : "  ");
-    if (use_vector) {
-      s += node_json(sorted_node_vector[i]).dump();
-    } else {
-      s += node_json(nit->second.get()).dump();
-    }
-    if (i+1 == m_nodes.size()) {
-      s += " ]";
-    } else {
-      s += ",\n";
-    }
+  nit = m_topology->nodes.begin();
+  for (i = 0; i < m_topology->nodes.size(); i++) {
+    out << indent << ((i == 0) ? "[ " : "  ");
+    write_node(out, use_vector ? sorted_node_vector[i] : nit->second.get());
+    out << ((i+1 == m_topology->nodes.size()) ? " ]" : ",\n");
     nit++;
   }
-  return s;
 }
 
-string Network::pretty_edges() const
+/* One edge per line.  If the nodes are sorted, then so are the edges. */
+
+void Network::write_edges(std::ostream &out, const string &indent) const
 {
-  json j1;
   size_t i, j;
-  string s;
+  bool first;
   Node *n;
   map <uint32_t, Edge *> m;
   map <uint32_t, Edge *>::iterator mit;
-  
-  if (num_edges() == 0) return "[]";
+  EdgeMap::const_iterator eit;
+
+  if (num_edges() == 0) {
+    out << indent << "[]";
+    return;
+  }
 
+  first = true;
   if (sorted_node_vector.size() == 0) {
-    j1 = as_json();
-    s = "";
-    for (i = 0; i < j1["Edges"].size(); i++) {
-      s += ((i == 0) ? "[ " : "  ");
-      s += j1["Edges"][i].dump();
-      if (i+1 == j1["Edges"].size()) {
-        s += " ]";
-      } else {
-        s += ",\n";
-      }
+    for (eit = m_topology->edges.begin(); eit != m_topology->edges.end(); eit++) {
+      out << ((first) ? indent + "[ " : ",\n" + indent + "  ");
+      write_edge(out, eit->second.get());
+      first = false;
     }
-    return s;
   } else {
-    s = "";
     for (i = 0; i < sorted_node_vector.size(); i++) {
       n = sorted_node_vector[i];
       m.clear();
@@ -1150,13 +2671,29 @@ string Network::pretty_edges() const
         m[n->outgoing[j]->to->id] = n->outgoing[j];
       }
       for (mit = m.begin(); mit != m.end(); mit++) {
-        s += ((s.size() == 0) ? "[ " : ",\n  ");
-        s += mit->second->as_json().dump();
+        out << ((first) ? indent + "[ " : ",\n" + indent + "  ");
+        write_edge(out, mit->second);
+        first = false;
       }
     }
-    s += " ]";
-    return s;
   }
+  out << " ]";
+}
+
+string Network::pretty_nodes() const
+{
+  std::ostringstream ss;
+
+  write_nodes(ss, "");
+  return ss.str();
+}
+
+string Network::pretty_edges() const
+{
+  std::ostringstream ss;
+
+  write_edges(ss, "");
+  return ss.str();
 }
 
 static void append_and_indent(const string &from, string &to, size_t chars)
@@ -1220,26 +2757,60 @@ static string pretty_json_generic(const json &j)
 
 string Network::pretty_json() const
 {
-  json j1;
+  std::ostringstream ss;
+
+  write_json(ss, true);
+  return ss.str();
+}
+
+/* This writes what as_json().dump() would (pretty = false), or what pretty_json()
+   always has (pretty = true), without building the json.  Only the properties
+   and the associated data, which are small, are made into json first. */
+
+void Network::write_json(std::ostream &out, bool pretty) const
+{
   string s;
+  const json empty = json::object();
+  const json &data = (m_associated_data == nullptr) ? empty : m_associated_data;
+
+  if (!pretty) {
+    out << "{\"Associated_Data\":" << data.dump();
+    out << ",\"Edges\":[";
+    for (auto eit = m_topology->edges.begin(); eit != m_topology->edges.end(); eit++) {
+      if (eit != m_topology->edges.begin()) out.put(',');
+      write_edge(out, eit->second.get());
+    }
+    out << "],\"Inputs\":";
+    write_ids(out, m_inputs);
+    out << ",\"Network_Values\":";
+    write_doubles(out, values);
+    out << ",\"Nodes\":[";
+    for (auto nit = m_topology->nodes.begin(); nit != m_topology->nodes.end(); nit++) {
+      if (nit != m_topology->nodes.begin()) out.put(',');
+      write_node(out, nit->second.get());
+    }
+    out << "],\"Outputs\":";
+    write_ids(out, m_outputs);
+    out << ",\"Properties\":" << m_topology->properties.as_json().dump() << "}";
+    return;
+  }
 
-  j1 = as_json();
   s = "{ \"Properties\":\n";
-  append_and_indent(m_properties.pretty_json(), s, 2);
-  s += ",\n \"Nodes\":\n";
-  append_and_indent(pretty_nodes(), s, 2);
-  s += ",\n \"Edges\":\n";
-  append_and_indent(pretty_edges(), s, 2);
-  s += ",\n \"Inputs\": ";
-  s += j1["Inputs"].dump();
-  s += ",\n \"Outputs\": ";
-  s += j1["Outputs"].dump();
-  s += ",\n \"Network_Values\": ";
-  s += j1["Network_Values"].dump();
-  s += ",\n \"Associated_Data\":\n";
-  append_and_indent(pretty_json_generic(j1["Associated_Data"]), s, 2);
-  s += "}";
-  return s;
+  append_and_indent(m_topology->properties.pretty_json(), s, 2);
+  out << s << ",\n \"Nodes\":\n";
+  write_nodes(out, "  ");
+  out << ",\n \"Edges\":\n";
+  write_edges(out, "  ");
+  out << ",\n \"Inputs\": ";
+  write_ids(out, m_inputs);
+  out << ",\n \"Outputs\": ";
+  write_ids(out, m_outputs);
+  out << ",\n \"Network_Values\": ";
+  write_doubles(out, values);
+  out << ",\n \"Associated_Data\":\n";
+  s = "";
+  append_and_indent(pretty_json_generic(data), s, 2);
+  out << s << "}";
 }
 
 }  // End of neuro namespace
@@ -0,0 +1,387 @@
+/* Graph analysis of networks: reachability, SCCs, depth, path delays and fan-in/out. */
+
+#include "framework.hpp"
+#include <cstdio>
+#include <cmath>
+#include <limits>
+#include <queue>
+#include <functional>
+#include <algorithm>
+
+typedef std::runtime_error SRE;
+
+namespace neuro
+{
+using std::string;
+using std::vector;
+using std::pair;
+using std::make_pair;
+
+static const uint32_t UNSEEN = 0xffffffff;
+
+/* Build the CSR adjacency lists from the network.  The outgoing edges of each node
+   are laid down in the order of the node's outgoing vector; the incoming lists are
+   filled by counting, so that we only walk the edges twice. */
+
+NetworkGraph::NetworkGraph(Network *net, const string &delay_property)
+{
+  size_t i, j;
+  uint32_t k;
+  Node *n;
+  Edge *e;
+  const Property *p;
+  int delay_index;
+  double d;
+  char buf[200];
+
+  net->make_sorted_node_vector();
+  nodes = net->sorted_node_vector;
+
+  m_index.reserve(nodes.size());
+  for (i = 0; i < nodes.size(); i++) {
+    n = nodes[i];
+    m_index[n->id] = i;
+    if (n->input_id >= 0) m_inputs.push_back(i);
+    if (n->output_id >= 0) m_outputs.push_back(i);
+  }
+
+  /* Without the delay property, every edge has a delay of one. */
+
+  delay_index = -1;
+  if (net->is_edge_property(delay_property)) {
+    p = net->get_edge_property(delay_property);
+    delay_index = p->index;
+  }
+
+  m_out_start.resize(nodes.size() + 1, 0);
+  m_in_start.resize(nodes.size() + 1, 0);
+  m_out.reserve(net->num_edges());
+  m_out_delay.reserve(net->num_edges());
+
+  for (i = 0; i < nodes.size(); i++) {
+    n = nodes[i];
+    m_out_start[i] = m_out.size();
+    for (j = 0; j < n->outgoing.size(); j++) {
+      e = n->outgoing[j];
+      k = m_index.at(e->to->id);
+      d = 1;
+      if (delay_index >= 0) {
+        const ValueRow &r = e->values;
+        d = r[delay_index];
+      }
+      if (d < 0 || std::isnan(d)) {
+        snprintf(buf, 200, "NetworkGraph: Edge %u -> %u has a bad delay (%lg).", n->id, e->to->id, d);
+        throw SRE(buf);
+      }
+      m_out.push_back(k);
+      m_out_delay.push_back(d);
+      m_in_start[k+1]++;
+    }
+  }
+  m_out_start[nodes.size()] = m_out.size();
+
+  for (i = 0; i < nodes.size(); i++) m_in_start[i+1] += m_in_start[i];
+  m_in.resize(m_out.size());
+  m_in_delay.resize(m_out.size());
+  vector <uint32_t> fill(m_in_start.begin(), m_in_start.end() - 1);
+  for (i = 0; i < nodes.size(); i++) {
+    for (j = m_out_start[i]; j < m_out_start[i+1]; j++) {
+      k = fill[m_out[j]]++;
+      m_in[k] = i;
+      m_in_delay[k] = m_out_delay[j];
+    }
+  }
+
+  find_components();
+}
+
+size_t NetworkGraph::size() const
+{
+  return nodes.size();
+}
+
+int NetworkGraph::index(uint32_t node_id) const
+{
+  auto it = m_index.find(node_id);
+  return (it == m_index.end()) ? -1 : (int) it->second;
+}
+
+/* This is Tarjan's algorithm, with an explicit stack of (node, next edge) frames
+   instead of recursion.  Tarjan finishes the components in reverse topological order,
+   so we number them backwards. */
+
+void NetworkGraph::find_components()
+{
+  vector <uint32_t> idx, low, stack;
+  vector < pair <uint32_t, uint32_t> > frames;
+  vector <bool> on_stack;
+  vector <uint32_t> finished;
+  uint32_t counter, ncomp, s, v, w, c;
+  size_t i, n;
+
+  n = nodes.size();
+  idx.resize(n, UNSEEN);
+  low.resize(n, 0);
+  on_stack.resize(n, false);
+  m_comp.resize(n, 0);
+  counter = 0;
+  ncomp = 0;
+
+  for (s = 0; s < n; s++) {
+    if (idx[s] != UNSEEN) continue;
+    idx[s] = low[s] = counter++;
+    stack.push_back(s);
+    on_stack[s] = true;
+    frames.push_back(make_pair(s, m_out_start[s]));
+
+    while (!frames.empty()) {
+      v = frames.back().first;
+      if (frames.back().second < m_out_start[v+1]) {
+        w = m_out[frames.back().second++];
+        if (idx[w] == UNSEEN) {
+          idx[w] = low[w] = counter++;
+          stack.push_back(w);
+          on_stack[w] = true;
+          frames.push_back(make_pair(w, m_out_start[w]));
+        } else if (on_stack[w]) {
+          low[v] = std::min(low[v], idx[w]);
+        }
+      } else {
+        frames.pop_back();
+        if (!frames.empty()) {
+          w = frames.back().first;
+          low[w] = std::min(low[w], low[v]);
+        }
+        if (low[v] == idx[v]) {
+          do {
+            w = stack.back();
+            stack.pop_back();
+            on_stack[w] = false;
+            m_comp[w] = ncomp;
+          } while (w != v);
+          ncomp++;
+        }
+      }
+    }
+  }
+
+  /* Renumber topologically, and group the nodes by component. */
+
+  for (i = 0; i < n; i++) m_comp[i] = ncomp - 1 - m_comp[i];
+
+  m_comp_start.resize(ncomp + 1, 0);
+  for (i = 0; i < n; i++) m_comp_start[m_comp[i]+1]++;
+  for (c = 0; c < ncomp; c++) m_comp_start[c+1] += m_comp_start[c];
+  m_order.resize(n);
+  finished.assign(m_comp_start.begin(), m_comp_start.end() - 1);
+  for (i = 0; i < n; i++) m_order[finished[m_comp[i]]++] = i;
+
+  /* A component is cyclic if it has more than one node, or its node has a self-loop. */
+
+  m_cyclic.resize(ncomp, false);
+  for (c = 0; c < ncomp; c++) {
+    if (m_comp_start[c+1] - m_comp_start[c] > 1) {
+      m_cyclic[c] = true;
+    } else {
+      v = m_order[m_comp_start[c]];
+      for (i = m_out_start[v]; i < m_out_start[v+1]; i++) {
+        if (m_out[i] == v) m_cyclic[c] = true;
+      }
+    }
+  }
+}
+
+/* Breadth-first search from the given nodes, along the given adjacency lists. */
+
+static vector <bool> reach(const vector <uint32_t> &sources,
+                           const vector <uint32_t> &start,
+                           const vector <uint32_t> &adj)
+{
+  vector <bool> seen(start.size() - 1, false);
+  vector <uint32_t> queue;
+  size_t head, i;
+  uint32_t v;
+
+  for (i = 0; i < sources.size(); i++) {
+    if (!seen[sources[i]]) {
+      seen[sources[i]] = true;
+      queue.push_back(sources[i]);
+    }
+  }
+  for (head = 0; head < queue.size(); head++) {
+    v = queue[head];
+    for (i = start[v]; i < start[v+1]; i++) {
+      if (!seen[adj[i]]) {
+        seen[adj[i]] = true;
+        queue.push_back(adj[i]);
+      }
+    }
+  }
+  return seen;
+}
+
+vector <bool> NetworkGraph::from_inputs() const
+{
+  return reach(m_inputs, m_out_start, m_out);
+}
+
+vector <bool> NetworkGraph::to_outputs() const
+{
+  return reach(m_outputs, m_in_start, m_in);
+}
+
+vector < vector <uint32_t> > NetworkGraph::components() const
+{
+  vector < vector <uint32_t> > rv;
+  size_t c, i;
+
+  rv.resize(m_cyclic.size());
+  for (c = 0; c < rv.size(); c++) {
+    for (i = m_comp_start[c]; i < m_comp_start[c+1]; i++) rv[c].push_back(nodes[m_order[i]]->id);
+  }
+  return rv;
+}
+
+bool NetworkGraph::is_feed_forward() const
+{
+  return std::find(m_cyclic.begin(), m_cyclic.end(), true) == m_cyclic.end();
+}
+
+/* A component with no edges coming in from other components has depth zero.  Otherwise,
+   its depth is one more than the deepest component with an edge into it. */
+
+vector <int> NetworkGraph::depths() const
+{
+  vector <int> cdepth(m_cyclic.size(), 0);
+  vector <int> rv(nodes.size());
+  size_t c, i, j;
+  uint32_t v, u;
+
+  for (c = 0; c < m_cyclic.size(); c++) {
+    for (i = m_comp_start[c]; i < m_comp_start[c+1]; i++) {
+      v = m_order[i];
+      for (j = m_in_start[v]; j < m_in_start[v+1]; j++) {
+        u = m_in[j];
+        if (m_comp[u] != c) cdepth[c] = std::max(cdepth[c], cdepth[m_comp[u]] + 1);
+      }
+    }
+  }
+  for (i = 0; i < nodes.size(); i++) rv[i] = cdepth[m_comp[i]];
+  return rv;
+}
+
+/* Dijkstra from all of the inputs at once.  The delays are non-negative. */
+
+vector <double> NetworkGraph::shortest_delays() const
+{
+  typedef pair <double, uint32_t> Entry;
+  std::priority_queue < Entry, vector <Entry>, std::greater <Entry> > pq;
+  vector <double> rv(nodes.size(), -1);
+  vector <bool> done(nodes.size(), false);
+  size_t i;
+  uint32_t v, w;
+  double d;
+
+  for (i = 0; i < m_inputs.size(); i++) {
+    rv[m_inputs[i]] = 0;
+    pq.push(Entry(0, m_inputs[i]));
+  }
+
+  while (!pq.empty()) {
+    d = pq.top().first;
+    v = pq.top().second;
+    pq.pop();
+    if (done[v]) continue;
+    done[v] = true;
+    for (i = m_out_start[v]; i < m_out_start[v+1]; i++) {
+      w = m_out[i];
+      if (rv[w] < 0 || d + m_out_delay[i] < rv[w]) {
+        rv[w] = d + m_out_delay[i];
+        pq.push(Entry(rv[w], w));
+      }
+    }
+  }
+  return rv;
+}
+
+/* Longest paths over the components in topological order.  A reachable cyclic
+   component has paths of unbounded delay, and so does everything after it. */
+
+vector <double> NetworkGraph::longest_delays() const
+{
+  vector <double> rv(nodes.size(), -1);
+  vector <bool> reached;
+  double inf;
+  size_t c, i, j;
+  uint32_t v, u;
+
+  inf = std::numeric_limits<double>::infinity();
+  reached = from_inputs();
+  for (i = 0; i < m_inputs.size(); i++) rv[m_inputs[i]] = 0;
+
+  for (c = 0; c < m_cyclic.size(); c++) {
+    v = m_order[m_comp_start[c]];
+    if (!reached[v]) continue;
+    if (m_cyclic[c]) {
+      for (i = m_comp_start[c]; i < m_comp_start[c+1]; i++) rv[m_order[i]] = inf;
+      continue;
+    }
+    for (j = m_in_start[v]; j < m_in_start[v+1]; j++) {
+      u = m_in[j];
+      if (rv[u] < 0) continue;
+      rv[v] = std::max(rv[v], rv[u] + m_in_delay[j]);
+    }
+  }
+  return rv;
+}
+
+double NetworkGraph::shortest_io_delay() const
+{
+  vector <double> d;
+  double rv;
+  size_t i;
+
+  d = shortest_delays();
+  rv = -1;
+  for (i = 0; i < m_outputs.size(); i++) {
+    if (d[m_outputs[i]] >= 0 && (rv < 0 || d[m_outputs[i]] < rv)) rv = d[m_outputs[i]];
+  }
+  return rv;
+}
+
+double NetworkGraph::longest_io_delay() const
+{
+  vector <double> d;
+  double rv;
+  size_t i;
+
+  d = longest_delays();
+  rv = -1;
+  for (i = 0; i < m_outputs.size(); i++) rv = std::max(rv, d[m_outputs[i]]);
+  return rv;
+}
+
+static vector <size_t> histogram(const vector <uint32_t> &start)
+{
+  vector <size_t> rv;
+  size_t i, k;
+
+  for (i = 0; i + 1 < start.size(); i++) {
+    k = start[i+1] - start[i];
+    if (k >= rv.size()) rv.resize(k + 1, 0);
+    rv[k]++;
+  }
+  return rv;
+}
+
+vector <size_t> NetworkGraph::fan_in_histogram() const
+{
+  return histogram(m_in_start);
+}
+
+vector <size_t> NetworkGraph::fan_out_histogram() const
+{
+  return histogram(m_out_start);
+}
+
+}   // End of neuro namespace.
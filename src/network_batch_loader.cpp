@@ -0,0 +1,146 @@
+/* Loading many network files at once, on a pool of threads. */
+
+#include "framework.hpp"
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <sys/stat.h>
+
+typedef std::runtime_error SRE;
+
+namespace neuro
+{
+using std::string;
+using std::vector;
+
+NetworkBatchLoader::NetworkBatchLoader(int threads, size_t bytes)
+  : max_threads(threads), max_bytes(bytes)
+{
+  if (max_threads < 0) throw SRE("NetworkBatchLoader: max_threads must be >= 0");
+}
+
+/* The state that the workers share.  Each worker takes the next file, waits until
+   its bytes fit under max_bytes, and loads it.  A file bigger than max_bytes by
+   itself is loaded when nothing else is. */
+
+struct BatchState {
+  const vector <string> *filenames;
+  vector <Network *> nets;
+  vector <string> errors;
+  size_t next;
+  size_t max_bytes;
+  size_t in_flight;
+  bool failed;
+  std::mutex lock;
+  std::condition_variable cv;
+};
+
+static size_t file_size(const string &filename)
+{
+  struct stat st;
+
+  if (stat(filename.c_str(), &st) != 0) return 0;
+  return st.st_size;
+}
+
+static void batch_worker(BatchState *s)
+{
+  size_t i, bytes;
+  Network *net;
+
+  while (true) {
+    {
+      std::unique_lock <std::mutex> lk(s->lock);
+      if (s->failed || s->next == s->filenames->size()) return;
+      i = s->next++;
+      bytes = file_size((*s->filenames)[i]);
+      if (s->max_bytes != 0) {
+        while (!s->failed && s->in_flight != 0 && s->in_flight + bytes > s->max_bytes) s->cv.wait(lk);
+        if (s->failed) return;
+      }
+      s->in_flight += bytes;
+    }
+
+    net = new Network();
+    try {
+      if (Network::is_binary_file((*s->filenames)[i])) {
+        net->load_binary((*s->filenames)[i]);
+      } else {
+        net->from_json_file((*s->filenames)[i]);
+      }
+      s->nets[i] = net;
+    } catch (const std::exception &e) {
+      delete net;
+      s->errors[i] = e.what();
+      if (s->errors[i] == "") s->errors[i] = "The network could not be loaded";
+    } catch (...) {
+      delete net;
+      s->errors[i] = "Unknown error";
+    }
+
+    {
+      std::unique_lock <std::mutex> lk(s->lock);
+      s->in_flight -= bytes;
+      if (s->nets[i] == nullptr) s->failed = true;
+    }
+    s->cv.notify_all();
+  }
+}
+
+vector <Network *> NetworkBatchLoader::load(const vector <string> &filenames) const
+{
+  BatchState s;
+  vector <std::thread> threads;
+  size_t nt, i;
+  string error;
+
+  s.filenames = &filenames;
+  s.nets.resize(filenames.size(), nullptr);
+  s.errors.resize(filenames.size());
+  s.next = 0;
+  s.max_bytes = max_bytes;
+  s.in_flight = 0;
+  s.failed = false;
+
+  nt = max_threads;
+  if (nt == 0) nt = std::thread::hardware_concurrency();
+  if (nt == 0) nt = 1;
+  if (nt > filenames.size()) nt = filenames.size();
+
+  /* With one thread, there's no reason to start another. */
+
+  if (nt == 1) {
+    batch_worker(&s);
+  } else {
+    for (i = 0; i < nt; i++) threads.push_back(std::thread(batch_worker, &s));
+    for (i = 0; i < nt; i++) threads[i].join();
+  }
+
+  /* A file failed if it has no network.  The files after a failure may not have been
+     tried, so report the first one with an error, and delete everything else. */
+
+  for (i = 0; i < filenames.size() && s.nets[i] != nullptr; i++) ;
+  if (i < filenames.size()) {
+    for (i = 0; i < filenames.size() && error == ""; i++) {
+      if (s.errors[i] != "") error = filenames[i] + ": " + s.errors[i];
+    }
+    for (i = 0; i < s.nets.size(); i++) delete s.nets[i];
+    throw SRE("NetworkBatchLoader: " + error);
+  }
+  return s.nets;
+}
+
+vector <Network *> NetworkBatchLoader::load_networks(Processor *p, const vector <string> &filenames) const
+{
+  vector <Network *> nets;
+  size_t i;
+
+  nets = load(filenames);
+  if (!p->load_networks(nets)) {
+    for (i = 0; i < nets.size(); i++) delete nets[i];
+    throw SRE("NetworkBatchLoader: The processor's load_networks() failed.");
+  }
+  return nets;
+}
+
+}   // End of neuro namespace.
@@ -8,6 +8,7 @@
 #include <unistd.h>
 #include "framework.hpp"
 #include "utils/json_helpers.hpp"
+#include "utils/file_helpers.hpp"
 #include "utils/sys_helpers.hpp"
 
 using namespace std;
@@ -23,15 +24,21 @@ void print_commands(FILE *f)
   fprintf(f, "or the json can be multiple lines, starting on the next line.\n");
 
   fprintf(f, "\nCreate/Clear Network Commands\n");
-  fprintf(f, "FJ json                    - Read a network.\n");
+  fprintf(f, "FJ json                    - Read a network.  A binary network file works too.\n");
   fprintf(f, "TJ [file]                  - Create JSON from the network.\n");
+  fprintf(f, "TB file                    - Write the network in the binary format.\n");
+  fprintf(f, "CHECK_JSON                 - Check the compact streamed JSON against as_json().dump().\n");
   fprintf(f, "COPY_FROM                  - Make a copy of yourself using copy_from.  Print & delete.\n");
+  fprintf(f, "CHECK_MOVE                 - Move the network out and back, checking the moved-from networks.\n");
+  fprintf(f, "CHECK_COPY                 - Copy the network, checking that reading the copy shares its nodes and values.\n");
   fprintf(f, "DESTROY                    - Delete network, create empty network.\n");
   fprintf(f, "CLEAR                      - Clear network\n");
   fprintf(f, "CLEAR_KP                   - Clear network but keep the property pack intact\n");     
+  fprintf(f, "RANDOM json                - Replace the network with a random one, keeping the property pack & data\n");
   
   fprintf(f, "\nAccess Network Info Commands\n");
   fprintf(f, "INFO                       - Print some info about the network.\n");
+  fprintf(f, "ANALYZE [delay_pname]      - Print cycles, depth, I/O delays and fan-in/fan-out.\n");
   fprintf(f, "NODES [node_id] [...]      - Print the nodes using a kind of user-friendly JSON format.\n");
   fprintf(f, "EDGES [from] [to] [...]    - Print the edges using a kind of user-friendly JSON format.\n");
   fprintf(f, "PROPERTIES/P               - Print the network's property pack.\n");
@@ -64,6 +71,8 @@ void print_commands(FILE *f)
   fprintf(f, "SEED val                   - Seed the RNG\n");
   fprintf(f, "SHOW_SEED                  - Show the RNG seed\n");
   fprintf(f, "RE_SEED                    - Re-seed the RNG based on the current time & show seed\n");
+  fprintf(f, "PICK_NODES count           - Print count nodes from get_random_node(), using the RNG\n");
+  fprintf(f, "PICK_EDGES count           - Print count edges from get_random_edge(), using the RNG\n");
   fprintf(f, "SPROPERTIES/SP json        - Set the network's property pack\n");
   fprintf(f, "SET_ASSOC key json         - Set the key/val in the network's associated data.\n");
   fprintf(f, "SORT/SORTED [Q]            - Sort the network and print the sorted node id's. Q = no output\n");
@@ -99,7 +108,7 @@ bool read_json(const vector <string> &sv, size_t starting_field, json &rv)
 {
   bool success;
   string s;
-  ifstream fin;
+  InputFile fin;
 
   rv.clear();
   if (starting_field < sv.size()) {
@@ -134,8 +143,8 @@ string get_node_name(Node *n)
   string id;
   
   id = std::to_string(n->id);
-  if (n->name == "") return id;
-  return id + "(" + n->name + ")";
+  if (n->get_name() == "") return id;
+  return id + "(" + n->get_name() + ")";
 }
 
 
@@ -145,12 +154,15 @@ int main(int argc, char **argv)
   Edge *e;
   Node *node;
   PropertyPack pp;
-  const Property *prop;
   NodeMap::iterator nit;
   EdgeMap::iterator eit;
+  NodeMap::const_iterator cnit;
+  EdgeMap::const_iterator ceit;
+  const Network *cn2;
 
   istringstream ss;
-  ofstream fout;
+  ostringstream oss;
+  OutputFile fout;
   vector <string> sv;
   vector <string> keys;
   vector <double> dv;
@@ -161,6 +173,8 @@ int main(int argc, char **argv)
   json j1;
   int lowest_free_id;
   uint32_t seed;
+  uint64_t hash;
+  bool binary;
 
   double d;
   int from, to, id;
@@ -185,6 +199,8 @@ int main(int argc, char **argv)
     prompt += " ";
   }
 
+  cin_from_compressed_file();
+
   n = new Network;
   n2 = new Network;
   e = NULL;
@@ -192,7 +208,13 @@ int main(int argc, char **argv)
 
   while (1) {
     if (prompt != "") printf("%s", prompt.c_str());
-    if (!getline(cin, l)) return 0;
+    if (!getline(cin, l)) {
+      if (cin.bad()) {
+        fprintf(stderr, "Error reading the commands.\n");
+        return 1;
+      }
+      return 0;
+    }
     sv.clear();
     ss.clear();
     ss.str(l);
@@ -212,14 +234,19 @@ int main(int argc, char **argv)
     /* To / From Json. */
 
     } else if (sv[0] == "FJ") {
-      if (!read_json(sv, 1, j1)) {
+      binary = (size > 1 && Network::is_binary_file(sv[1]));
+      if (!binary && !read_json(sv, 1, j1)) {
         printf("Bad json.\n");
       } else {
         try {
           node_names.clear();
           lowest_free_id = 0;
 
-          n->from_json(j1);
+          if (binary) {
+            n->load_binary(sv[1]);
+          } else {
+            n->from_json(j1);
+          }
 
           for (nit = n->begin(); nit != n->end(); nit++) {
             node = nit->second.get();
@@ -245,21 +272,143 @@ int main(int argc, char **argv)
       rng.Seed(seed, "network_tool");
       printf("%u\n", seed);
 
+    } else if (sv[0] == "PICK_NODES" || sv[0] == "PICK_EDGES") {
+      if (sv.size() != 2 || sscanf(sv[1].c_str(), "%d", &id) != 1 || id < 0) {
+        printf("usage: %s count\n", sv[0].c_str());
+      } else {
+        try {
+          for (i = 0; i < (size_t) id; i++) {
+            if (sv[0] == "PICK_NODES") {
+              printf("%s%s", (i == 0) ? "" : " ", get_node_name(n->get_random_node(rng)).c_str());
+            } else {
+              e = n->get_random_edge(rng);
+              printf("%s%s->%s", (i == 0) ? "" : " ", get_node_name(e->from).c_str(),
+                     get_node_name(e->to).c_str());
+            }
+          }
+          printf("\n");
+        } catch (SRE &e) {
+          printf("%s\n", e.what());
+        }
+        e = NULL;
+      }
+
     } else if (sv[0] == "TJ") {
       try {
         if (size > 1) {
           fout.clear();
           fout.open(sv[1].c_str());
           if (fout.fail()) throw SRE((string) "Couldn't open " + sv[1]);
-          fout << n->pretty_json() << endl;
+          n->write_json(fout, true);
+          fout << endl;
           fout.close();
         } else {
-          cout << n->pretty_json() << endl;
+          n->write_json(cout, true);
+          cout << endl;
         }
       } catch (SRE &e) {
         printf("%s\n", e.what());
       }
 
+    } else if (sv[0] == "TB") {
+      try {
+        if (size != 2) throw SRE("usage: TB file");
+        n->save_binary(sv[1]);
+      } catch (SRE &e) {
+        printf("%s\n", e.what());
+      }
+
+    } else if (sv[0] == "CHECK_JSON") {
+      try {
+        if (size != 1) throw SRE("usage: CHECK_JSON");
+        j1 = n->as_json();
+        oss.str("");
+        n->write_json(oss, false);
+        if (oss.str() != j1.dump()) {
+          throw SRE("CHECK_JSON: write_json() doesn't match as_json().dump()");
+        }
+      } catch (SRE &e) {
+        printf("%s\n", e.what());
+      }
+
+    } else if (sv[0] == "CHECK_MOVE") {
+
+      /* Move the network to n2 and back.  Each time, the moved-from network has
+         to be empty, and it has to take nodes and edges again. */
+
+      try {
+        if (size != 1) throw SRE("usage: CHECK_MOVE");
+        hash = n->content_hash(true);
+        *n2 = std::move(*n);
+        *n = std::move(*n2);
+        if (n->content_hash(true) != hash) throw SRE("CHECK_MOVE: The network changed");
+        *n2 = std::move(*n);
+        if (n->num_nodes() != 0 || n->num_edges() != 0 || n->num_inputs() != 0 ||
+            n->num_outputs() != 0) {
+          throw SRE("CHECK_MOVE: The moved-from network isn't empty");
+        }
+        n->add_node(0);
+        n->add_edge(0, 0);
+        n->clear(true);
+        *n = std::move(*n2);
+        if (n->content_hash(true) != hash) throw SRE("CHECK_MOVE: The network changed");
+      } catch (SRE &e) {
+        printf("%s\n", e.what());
+      }
+
+    } else if (sv[0] == "CHECK_COPY") {
+
+      /* Copy the network to n2 and read all of it through a const pointer.  That
+         mustn't unshare the nodes and edges.  Then read every value through n2's
+         non-const rows.  Getting the non-const nodes unshares the nodes and edges, but
+         mustn't unshare any of the value chunks.  Then writing one value should unshare
+         just the chunk that holds it, and leave n alone. */
+
+      try {
+        if (size != 1) throw SRE("usage: CHECK_COPY");
+        hash = n->content_hash(true);
+        *n2 = *n;
+        cn2 = n2;
+        d = 0;
+        for (cnit = cn2->begin(); cnit != cn2->end(); cnit++) {
+          for (double v : cnit->second->values) d += v;
+        }
+        for (ceit = cn2->edges_begin(); ceit != cn2->edges_end(); ceit++) {
+          for (double v : ceit->second->values) d += v;
+        }
+        if (cn2->content_hash(true) != hash) throw SRE("CHECK_COPY: The copy is different");
+        n2->make_sorted_node_vector();
+        if (!n2->shares_topology(*n)) {
+          throw SRE("CHECK_COPY: Reading the copy through const unshared its nodes and edges");
+        }
+        for (nit = n2->begin(); nit != n2->end(); nit++) {
+          for (i = 0; i < nit->second->values.size(); i++) d += nit->second->values[i];
+        }
+        for (eit = n2->edges_begin(); eit != n2->edges_end(); eit++) {
+          for (double v : eit->second->values) d += v;
+        }
+        if (n2->num_nodes() != 0 && n2->shares_topology(*n)) {
+          throw SRE("CHECK_COPY: Getting the copy's nodes didn't unshare them");
+        }
+        if (n2->shared_value_chunks(*n) != n->value_chunks()) {
+          throw SRE("CHECK_COPY: Reading the copy's values unshared " +
+                    std::to_string(n->value_chunks() - n2->shared_value_chunks(*n)) + " of " +
+                    std::to_string(n->value_chunks()) + " chunks");
+        }
+        if (n2->num_edges() != 0 && n2->edges_begin()->second->values.size() != 0) {
+          e = n2->edges_begin()->second.get();
+          e->values[0] = e->values[0] + 1;
+          if (n2->shared_value_chunks(*n) != n->value_chunks() - 1) {
+            throw SRE("CHECK_COPY: Writing one value didn't unshare exactly one chunk");
+          }
+          if (n->content_hash(true) != hash) throw SRE("CHECK_COPY: Writing the copy changed the network");
+        }
+        n2->clear(true);
+        e = NULL;
+      } catch (SRE &e) {
+        printf("%s\n", e.what());
+      }
+
     } else if (sv[0] == "PRUNE") {
       try {
         if (size != 1) throw SRE("usage: PRUNE");
@@ -303,7 +452,7 @@ int main(int argc, char **argv)
             node = n->get_node(id);
             j1 = { {"id", node->id}, 
                    {"values", node->values} };
-            if (node->coordinates.size() != 0) j1["coords"] = j1["coords"] = node->coordinates;
+            if (node->get_coordinates().size() != 0) j1["coords"] = node->get_coordinates();
             cout << j1.dump() << endl;
           } catch (SRE &e) {
             printf("%s\n",e.what());
@@ -394,6 +543,51 @@ int main(int argc, char **argv)
       }
       printf("\n");
 
+    } else if (sv[0] == "ANALYZE") {
+      try {
+        if (size > 2) throw SRE("usage: ANALYZE [delay_pname]");
+        NetworkGraph g(n, (size == 2) ? sv[1] : "Delay");
+        vector <bool> fi, to;
+        vector < vector <uint32_t> > comps;
+        vector <int> depths;
+        vector <size_t> hist;
+        int cyclic, dead, depth;
+
+        fi = g.from_inputs();
+        to = g.to_outputs();
+        dead = 0;
+        for (i = 0; i < g.size(); i++) if (!fi[i] || !to[i]) dead++;
+
+        comps = g.components();
+        cyclic = 0;
+        for (i = 0; i < comps.size(); i++) {
+          if (comps[i].size() > 1 || n->is_edge(comps[i][0], comps[i][0])) cyclic++;
+        }
+
+        depths = g.depths();
+        depth = 0;
+        for (i = 0; i < depths.size(); i++) depth = std::max(depth, depths[i]);
+
+        printf("Feed-forward:       %s\n", g.is_feed_forward() ? "yes" : "no");
+        printf("Cyclic SCCs:        %d\n", cyclic);
+        printf("Max depth:          %d\n", depth);
+        printf("Off I/O paths:      %d\n", dead);
+        printf("Shortest I/O delay: %lg\n", g.shortest_io_delay());
+        printf("Longest I/O delay:  %lg\n", g.longest_io_delay());
+
+        hist = g.fan_in_histogram();
+        printf("Fan-in histogram:  ");
+        for (i = 0; i < hist.size(); i++) if (hist[i] != 0) printf(" %d:%d", (int) i, (int) hist[i]);
+        printf("\n");
+
+        hist = g.fan_out_histogram();
+        printf("Fan-out histogram: ");
+        for (i = 0; i < hist.size(); i++) if (hist[i] != 0) printf(" %d:%d", (int) i, (int) hist[i]);
+        printf("\n");
+      } catch (SRE &e) {
+        printf("%s\n",e.what());
+      }
+
     } else if (sv[0] == "CLEAR-KP" || sv[0] == "CLEAR_KP") {   // Keeping the - for backward compatability.
       n->clear(false);
       node_names.clear();
@@ -404,6 +598,23 @@ int main(int argc, char **argv)
       node_names.clear();
       lowest_free_id = 0;
 
+    } else if (sv[0] == "RANDOM") {
+      if (!read_json(sv, 1, j1)) {
+        printf("RANDOM: Bad json.\n");
+      } else {
+        try {
+          n->randomize(rng, j1);
+        } catch (SRE &e) {
+          printf("%s\n", e.what());
+        }
+        node_names.clear();
+        lowest_free_id = 0;
+        for (nit = n->begin(); nit != n->end(); nit++) {
+          node = nit->second.get();
+          node_names[std::to_string(node->id)] = node->id;
+        }
+      }
+
     } else if (sv[0] == "NM") {
       if (size == 1) cout << (json) node_names << endl;
       else {
@@ -483,11 +694,7 @@ int main(int argc, char **argv)
         printf("edge property \"%s\" doesn't exist.\n", sv[size - 2].c_str());
 
       } else {
-        prop = n->get_edge_property(sv[size-2]);
-        for (eit = n->edges_begin(); eit != n->edges_end(); eit++) {
-          e = eit->second.get();
-          e->set(prop->index, d);
-        }
+        for (double &v : n->edge_column(sv[size-2])) v = d;
       }
 
     } else if (sv[0] == "SNP") {  // set node property
@@ -527,11 +734,7 @@ int main(int argc, char **argv)
         printf("node property \"%s\" doesn't exist.\n", sv[size - 2].c_str());
 
       } else {
-        prop = n->get_node_property(sv[size-2]);
-        for (nit = n->begin(); nit != n->end(); nit++) {
-          node = nit->second.get();
-          node->set(prop->index, d);
-        }
+        for (double &v : n->node_column(sv[size-2])) v = d;
       }
 
     } else if (sv[0] == "AN") { // add_node()
@@ -555,7 +758,7 @@ int main(int argc, char **argv)
               while (n->is_node(lowest_free_id)) lowest_free_id++;
               node_names[sv[i]] = lowest_free_id;
               node = n->add_node(lowest_free_id);
-              node->name = sv[i];
+              node->set_name(sv[i]);
               lowest_free_id++;
             }
 
@@ -805,8 +1008,7 @@ int main(int argc, char **argv)
           if (id == -1) throw SRE(sv[1] + " is not a valid node");
           node = n->get_node(id);
 
-          if (sv[2] == "-") node->name = "";
-          else node->name = sv[2];
+          node->set_name((sv[2] == "-") ? "" : sv[2]);
         } catch (SRE &e) {
           printf("%s\n",e.what());
         } 
@@ -825,7 +1027,7 @@ int main(int argc, char **argv)
 
           dv.clear();
           for (i = 2; i < std::min( (size_t) 4, sv.size()); i++) dv.push_back(stod(sv[i]));
-          node->coordinates = dv;
+          node->set_coordinates(dv);
 
         } catch (SRE &e) {
           printf("%s\n",e.what());
@@ -837,8 +1039,8 @@ int main(int argc, char **argv)
     } else if (sv[0] == "CLEAR_VIZ") {
       for (nit = n->begin(); nit != n->end(); nit++) {
         node = nit->second.get();
-        node->coordinates.clear();
-        for (i = 0; i < node->outgoing.size(); i++) node->outgoing[i]->control_point.clear();
+        node->set_coordinates(vector <double>());
+        for (i = 0; i < node->outgoing.size(); i++) node->outgoing[i]->set_control_point(vector <double>());
       }
 
     } else if (sv[0] == "SET_CP") {
@@ -857,7 +1059,7 @@ int main(int argc, char **argv)
           e = n->get_edge(from, to);
           dv.clear();
           for (i = 3; i < std::min( (size_t) 5, sv.size()); i++) dv.push_back(stod(sv[i]));
-          e->control_point = dv;
+          e->set_control_point(dv);
         } catch (SRE &e) {
           printf("%s\n",e.what());
         } 
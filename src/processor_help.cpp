@@ -43,9 +43,10 @@ bool track_all_output_events(Processor *p, Network *n, int network_id)
 
 bool track_all_neuron_events(Processor *p, Network *n, int network_id)
 {
-  NodeMap::iterator nit;
+  const Network *cn = n;      /* Iterating through const doesn't unshare a copied network */
+  NodeMap::const_iterator nit;
 
-  for (nit = n->begin(); nit != n->end(); nit++) {
+  for (nit = cn->begin(); nit != cn->end(); nit++) {
     if (!p->track_neuron_events(nit->second->id, true, network_id)) return false;
   }
 
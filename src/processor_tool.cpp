@@ -9,6 +9,10 @@
 #include <unistd.h>
 #include "framework.hpp"
 #include "utils/json_helpers.hpp"
+#include "utils/file_helpers.hpp"
+#ifdef PROCESSOR_TOOL_VRISP
+#include "vrisp.hpp"
+#endif
 
 using namespace std;
 using namespace neuro;
@@ -25,6 +29,10 @@ void to_uppercase(string &s);
 /** Make sure the spike has the legal id, time, and value. **/
 void spike_validation(const Spike &s, const Network *n, bool normalized);
 
+/** Apply the spikes that AS/ASV have queued, add them to "applied", and clear the queue */
+void apply_queued_spikes(Processor *p, const Network *net, vector <Spike> &queued,
+                         bool normalized, vector <Spike> &applied);
+
 /** Make sure the node "node_id" is an output node in the network */
 void output_node_id_validation(const int node_id, const Network *n);
 
@@ -52,6 +60,10 @@ void print_commands(FILE *f)
   fprintf(f, "MAKE/M proc_name proc_param_json    - Make a new processor with no network\n");
   fprintf(f, "LOAD/L network_json                 - Load a network on the processor\n");
   fprintf(f, "ML network_json                     - Make a new processor from the network & load the network.\n");
+  fprintf(f, "LOADS copies network_json           - Load copies of the network with load_networks().  RUN runs them all,\n");
+  fprintf(f, "                                      and the other commands use the first.\n");
+  fprintf(f, "LOADF max_bytes network_file ...     - Load the files with a NetworkBatchLoader and load_networks().  max_bytes\n");
+  fprintf(f, "                                      caps the bytes being parsed at once (0 = no cap).  Like LOADS otherwise.\n");
 
   fprintf(f, "AS node_id spike_time spike_val ... - Apply normalized spikes to the network (note: node_id, not input_id)\n");
   fprintf(f, "ASV node_id spike_time spike_val .. - Apply unnormalized spikes to the network (note: node_id, not input_id)\n");
@@ -90,6 +102,18 @@ void print_commands(FILE *f)
   fprintf(f, "PULL_NETWORK file                   - Pull the network off the processor and store in  file.\n");
   fprintf(f, "\n");
 
+#ifdef PROCESSOR_TOOL_VRISP
+  fprintf(f, "VRISP batch commands (batch 0 holds the loaded network, one sample per lane) --\n");
+  fprintf(f, "BATCH samples                       - Load the network as a batch of \"samples\" samples\n");
+  fprintf(f, "BAS sample node_id spike_time spike_val ... - Apply normalized spikes to one sample\n");
+  fprintf(f, "BRUN simulation_time                - Run every sample for \"simulation_time\" cycles\n");
+  fprintf(f, "BOC sample                          - Output spike counts for one sample\n");
+  fprintf(f, "BOLF sample                         - Output last fire times for one sample\n");
+  fprintf(f, "BNCH sample                         - Neuron charges for one sample\n");
+  fprintf(f, "BCA                                 - Clear the activity of every sample\n");
+  fprintf(f, "\n");
+#endif
+
   fprintf(f, "Other info commands --\n");
   fprintf(f, "PARAMS [file]                       - Print the JSON that can recreate the processor\n");
   fprintf(f, "NP/PPACK                            - Print the PropertyPack that networks use with the processor.\n");
@@ -104,8 +128,8 @@ void print_commands(FILE *f)
 
 
 string node_name(Node *n) {
-  if (n->name == "") return std::to_string(n->id);
-  return (std::to_string(n->id)) + "(" + n->name + ")";
+  if (n->get_name() == "") return std::to_string(n->id);
+  return (std::to_string(n->id)) + "(" + n->get_name() + ")";
 }
 
 int max_node_name_len(Network *net) 
@@ -145,7 +169,7 @@ int node_validation(const Network *n, const string &node_id)
 
 void spike_validation(const Spike &s, const Network *n, bool normalized) 
 {
-  Node *node;
+  const Node *node;
   char buf[20];
 
   try {
@@ -167,9 +191,60 @@ void spike_validation(const Spike &s, const Network *n, bool normalized)
 
 }
 
+/* AS and ASV queue their spikes, and they are applied before the next command that
+   isn't AS or ASV, so that the processor gets them in one apply_spikes() call.  VRISP
+   checks every spike before it applies any, so when one is bad, they are applied one
+   at a time instead, which reports each bad spike as AS always has.  The other
+   processors get them one at a time. */
+
+void apply_queued_spikes(Processor *p, const Network *net, vector <Spike> &queued,
+                         bool normalized, vector <Spike> &applied)
+{
+  size_t i;
+  bool bulk;
+  vector <int> ids;
+  vector <double> times, values;
+#ifdef PROCESSOR_TOOL_VRISP
+  vrisp::Processor *vp;
+#endif
+
+  if (queued.empty()) return;
+  for (i = 0; i < queued.size(); i++) {
+    ids.push_back(net->get_node(queued[i].id)->input_id);
+    times.push_back(queued[i].time);
+    values.push_back(queued[i].value);
+  }
+  bulk = false;
+
+#ifdef PROCESSOR_TOOL_VRISP
+  vp = dynamic_cast <vrisp::Processor *> (p);
+  if (vp != nullptr) {
+    try {
+      vp->apply_spikes(ids, times, values, normalized);
+      applied.insert(applied.end(), queued.begin(), queued.end());
+      bulk = true;
+    } catch (const SRE &e) {
+    }
+  }
+#endif
+
+  if (!bulk) {
+    for (i = 0; i < queued.size(); i++) {
+      try {
+        p->apply_spike(Spike(ids[i], times[i], values[i]), normalized);
+        applied.push_back(queued[i]);
+      } catch (const SRE &e) {
+        printf("%s\n", e.what());
+      }
+    }
+  }
+
+  queued.clear();
+}
+
 void output_node_id_validation(const int node_id, const Network *n) 
 {
-  Node *node;
+  const Node *node;
   char buf[20];
 
   try {
@@ -199,7 +274,7 @@ bool read_json(const vector <string> &sv, size_t starting_field, json &rv)
 {
   bool success;
   string s;
-  ifstream fin;
+  InputFile fin;
 
   rv.clear();
   if (starting_field < sv.size()) {
@@ -224,17 +299,57 @@ bool read_json(const vector <string> &sv, size_t starting_field, json &rv)
   }
 }
 
-Network *load_network(Processor **pp,
-                      const json &network_json)
+/* Reads the network for ML and LOAD.  A file in the binary format is read with
+   load_binary(), and any other file is streamed with from_json_stream(), so its
+   nodes and edges are never held in a json.  Returns nullptr if the json is bad,
+   and throws if the network is bad. */
+
+Network *read_network(const vector <string> &sv, size_t starting_field)
 {
   Network *net;
+  json network_json;
+  InputFile fin;
+
+  if (starting_field < sv.size()) {
+    fin.open(sv[starting_field].c_str());
+    if (fin.fail()) { 
+      perror(sv[starting_field].c_str());
+      return nullptr;
+    } 
+    net = new Network();
+    try {
+      if (Network::is_binary_file(sv[starting_field])) {
+        net->load_binary(sv[starting_field]);
+      } else {
+        net->from_json_stream(fin);
+      }
+    } catch (const json::parse_error &e) {
+      delete net;
+      return nullptr;
+    } catch (...) {
+      delete net;
+      throw;
+    }
+    return net;
+  }
+
+  if (!read_json(sv, starting_field, network_json)) return nullptr;
+  net = new Network();
+  try {
+    net->from_json(network_json);
+  } catch (...) {
+    delete net;
+    throw;
+  }
+  return net;
+}
+
+void load_network(Processor **pp, Network *net)
+{
   json proc_params;
   string proc_name;
   Processor *p;
 
-  net = new Network();
-  net->from_json(network_json);
-
   p = *pp;
   if (p == nullptr) {
     proc_params = net->get_data("proc_params");
@@ -249,8 +364,6 @@ Network *load_network(Processor **pp,
 
   if (!p->load_network(net)) throw SRE("load_network() failed");
   track_all_neuron_events(p, net);
-
-  return net;
 }
 
 
@@ -264,7 +377,7 @@ void safe_exit(Processor *p, Network *n)
 int main(int argc, char **argv) 
 {
   Processor *p;
-  Network *net, *pulled; 
+  Network *net, *new_net, *pulled; 
   NodeMap::iterator nit;
   Node *node, *n;
   char buf[50];
@@ -273,7 +386,7 @@ int main(int argc, char **argv)
   string cmd;
   string l,s;
 
-  ofstream fout;
+  OutputFile fout;
 
   istringstream ss;
  
@@ -290,6 +403,8 @@ int main(int argc, char **argv)
   vector <Node *> node_vector;
   vector <Spike> spikes_array;
   vector <Spike> spikes;
+  vector <Spike> queued_spikes;  // The spikes that AS/ASV have queued, by node id.
+  bool queued_normalized;
   vector <double> output_times; // hold return value of output_vector()
   vector < vector <double> > all_output_times; // hold return value of output_vectors()
   vector < vector< double> > neuron_times;     // hold the return value of neuron_times();
@@ -297,6 +412,11 @@ int main(int argc, char **argv)
   vector <int> v;
   vector <int> neuron_alias;
   vector <int> event_counts;
+  vector <int> network_ids;   // The networks that RUN runs
+  vector <Network *> copies;  // What LOADS gives load_networks()
+  vector <Network *> batch;   // What LOADF loaded, other than net
+  vector <string> files;      // LOADF's network files
+  size_t max_bytes;
   vector <uint32_t> pres, posts;
   vector <double> weights;
   vector <double> charges;
@@ -309,10 +429,14 @@ int main(int argc, char **argv)
   bool normalized;
   unordered_set <int> gsr_nodes;
   
-  json proc_params, network_json;
+  json proc_params;
   json spike_counts, spike_raster;
   json associated_data;
   json j1, j2;
+#ifdef PROCESSOR_TOOL_VRISP
+  vrisp::Processor *vp;
+  size_t sample;
+#endif
  
   if (argc > 2 || (argc == 2 && strcmp(argv[1], "--help") == 0)) {
     fprintf(stderr, "usage: processor_tool [prompt]\n");
@@ -326,14 +450,23 @@ int main(int argc, char **argv)
     prompt += " ";
   }
 
+  cin_from_compressed_file();
+
   p = nullptr;
   net = nullptr;
   max_name_len = 0;
+  queued_normalized = true;
 
   while(1) {
     try {
       if (prompt != "") printf("%s", prompt.c_str());
-      if (!getline(cin, l)) safe_exit(p, net);
+      if (!getline(cin, l)) {
+        if (cin.bad()) {
+          fprintf(stderr, "Error reading the commands.\n");
+          exit(1);
+        }
+        safe_exit(p, net);
+      }
       sv.clear();
       ss.clear();
       ss.str(l);
@@ -342,6 +475,10 @@ int main(int argc, char **argv)
   
       // convert cmd to uppercase
       if (sv.size() != 0) to_uppercase(sv[0]); 
+
+      if (sv.size() != 0 && sv[0][0] != '#' && sv[0] != "AS" && sv[0] != "ASV") {
+        apply_queued_spikes(p, net, queued_spikes, queued_normalized, spikes_array);
+      }
       
       if (sv.size() == 0 || sv[0][0] == '#') {
       } else if (sv[0] == "?") {
@@ -351,33 +488,36 @@ int main(int argc, char **argv)
 
       } else if (sv[0] == "ML") { // make() and load_network()
         
-        if (!read_json(sv, 1, network_json)) {
+        try {
   
-          printf("usage: ML network_json. Bad json\n");
-        } else {
+          new_net = read_network(sv, 1);
+          if (new_net == nullptr) {
   
-          try {
+            printf("usage: ML network_json. Bad json\n");
+          } else {
   
             if (p != nullptr) { delete p; p = nullptr; }
             if (net != nullptr) { delete net; net = nullptr; }
   
-            net = load_network(&p, network_json);
+            net = new_net;
+            load_network(&p, net);
+            network_ids.assign(1, 0);
             max_name_len = max_node_name_len(net);
+          }
   
-          } catch (const SRE &e) {
-            printf("%s\n",e.what());
-            if (net != nullptr) { delete net; net = nullptr; }
-            if (p != nullptr) { delete p; p = nullptr; }
-            net = nullptr;
-            p = nullptr;
-          } catch (...) {
-            printf("Unknown error when making processor\n");
-            if (net != nullptr) { delete net; net = nullptr; }
-            if (p != nullptr) { delete p; p = nullptr; }
-            net = nullptr;
-            p = nullptr;
+        } catch (const SRE &e) {
+          printf("%s\n",e.what());
+          if (net != nullptr) { delete net; net = nullptr; }
+          if (p != nullptr) { delete p; p = nullptr; }
+          net = nullptr;
+          p = nullptr;
+        } catch (...) {
+          printf("Unknown error when making processor\n");
+          if (net != nullptr) { delete net; net = nullptr; }
+          if (p != nullptr) { delete p; p = nullptr; }
+          net = nullptr;
+          p = nullptr;
   
-          }
         }
         
   
@@ -408,14 +548,18 @@ int main(int argc, char **argv)
         
         if (p == nullptr) {
           printf("Must make a processor first\n"); 
-        } else if (!read_json(sv, 1, network_json)){  
-          printf("usage: LOAD/L network_json. Bad json\n");
         } else {
-          if (net != nullptr) { delete net; net = nullptr; }
-          
           try {
-            net = load_network(&p, network_json);
-            max_name_len = max_node_name_len(net);
+            new_net = read_network(sv, 1);
+            if (new_net == nullptr) {
+              printf("usage: LOAD/L network_json. Bad json\n");
+            } else {
+              if (net != nullptr) { delete net; net = nullptr; }
+              net = new_net;
+              load_network(&p, net);
+              network_ids.assign(1, 0);
+              max_name_len = max_node_name_len(net);
+            }
 
           } catch (const SRE &e) {
             printf("%s\n",e.what());
@@ -426,6 +570,74 @@ int main(int argc, char **argv)
           }
         }
   
+      } else if (sv[0] == "LOADS") { // load_networks()
+
+        if (p == nullptr) {
+          printf("Must make a processor first\n");
+        } else if (sv.size() < 2 || sscanf(sv[1].c_str(), "%d", &k) != 1 || k <= 0) {
+          printf("usage: LOADS copies network_json. copies > 0\n");
+        } else {
+          try {
+            new_net = read_network(sv, 2);
+            if (new_net == nullptr) {
+              printf("usage: LOADS copies network_json. Bad json\n");
+            } else {
+              if (net != nullptr) { delete net; net = nullptr; }
+              net = new_net;
+              if (p->get_network_properties().as_json() != net->get_properties().as_json()) {
+                throw SRE("network and processor properties do not match.");
+              }
+              copies.assign(k, net);
+              if (!p->load_networks(copies)) throw SRE("load_networks() failed");
+              network_ids.clear();
+              for (i = 0; i < (size_t) k; i++) network_ids.push_back(i);
+              track_all_neuron_events(p, net);
+              max_name_len = max_node_name_len(net);
+            }
+
+          } catch (const SRE &e) {
+            printf("%s\n",e.what());
+            if (net != nullptr) { delete net; net = nullptr; }
+          } catch (...) {
+            printf("Unknown error when loading networks\n");
+            if (net != nullptr) { delete net; net = nullptr; }
+          }
+        }
+
+      } else if (sv[0] == "LOADF") { // NetworkBatchLoader and load_networks()
+
+        if (p == nullptr) {
+          printf("Must make a processor first\n");
+        } else if (sv.size() < 3 || sscanf(sv[1].c_str(), "%zu", &max_bytes) != 1) {
+          printf("usage: LOADF max_bytes network_file ...\n");
+        } else {
+          try {
+            files.assign(sv.begin() + 2, sv.end());
+            copies = NetworkBatchLoader(0, max_bytes).load(files);
+            if (net != nullptr) { delete net; net = nullptr; }
+            for (i = 0; i < batch.size(); i++) delete batch[i];
+            net = copies[0];
+            batch.assign(copies.begin() + 1, copies.end());
+            for (i = 0; i < copies.size(); i++) {
+              if (p->get_network_properties().as_json() != copies[i]->get_properties().as_json()) {
+                throw SRE(files[i] + ": network and processor properties do not match.");
+              }
+            }
+            if (!p->load_networks(copies)) throw SRE("load_networks() failed");
+            network_ids.clear();
+            for (i = 0; i < copies.size(); i++) network_ids.push_back(i);
+            track_all_neuron_events(p, net);
+            max_name_len = max_node_name_len(net);
+
+          } catch (const SRE &e) {
+            printf("%s\n",e.what());
+            if (net != nullptr) { delete net; net = nullptr; }
+          } catch (...) {
+            printf("Unknown error when loading networks\n");
+            if (net != nullptr) { delete net; net = nullptr; }
+          }
+        }
+
       } else if (sv[0] == "AS" || sv[0] == "ASV") { // apply_spike()
        
         if (network_processor_validation(net, p)) {
@@ -434,6 +646,10 @@ int main(int argc, char **argv)
           } else {
   
             normalized = (sv[0].size() == 2);
+            if (normalized != queued_normalized) {
+              apply_queued_spikes(p, net, queued_spikes, queued_normalized, spikes_array);
+              queued_normalized = normalized;
+            }
             for (i = 0; i < (sv.size() - 1) / 3; i++) {
               try {
   
@@ -446,8 +662,7 @@ int main(int argc, char **argv)
                 } 
                 spike_validation(Spike(spike_id, spike_time, spike_val), net, normalized);
                 
-                p->apply_spike(Spike(net->get_node(spike_id)->input_id, spike_time, spike_val), normalized);
-                spikes_array.push_back(Spike(spike_id, spike_time, spike_val));
+                queued_spikes.push_back(Spike(spike_id, spike_time, spike_val));
   
               } catch (const SRE &e) {
                 printf("%s\n",e.what());
@@ -495,7 +710,7 @@ int main(int argc, char **argv)
             printf("usage: RUN sim_time. sim_time >= 0\n");
           } else {
             
-            p->run(sim_time);
+            p->run(sim_time, network_ids);
             spikes_array.clear();
             
           }
@@ -919,6 +1134,91 @@ int main(int argc, char **argv)
         }
   
   
+#ifdef PROCESSOR_TOOL_VRISP
+      } else if (sv[0] == "BATCH") { // vrisp::Processor::load_batch()
+
+        if (network_processor_validation(net, p)) {
+          vp = dynamic_cast <vrisp::Processor *> (p);
+          if (sv.size() != 2 || sscanf(sv[1].c_str(), "%zu", &sample) != 1 || sample == 0) {
+            printf("usage: BATCH samples. samples > 0\n");
+          } else if (!vp->load_batch(net, sample)) {
+            printf("load_batch() failed\n");
+          }
+        }
+
+      } else if (sv[0] == "BAS") { // apply_batch_spike()
+
+        if (network_processor_validation(net, p)) {
+          vp = dynamic_cast <vrisp::Processor *> (p);
+          if (sv.size() < 5 || (sv.size() - 2) % 3 != 0 || sscanf(sv[1].c_str(), "%zu", &sample) != 1) {
+            printf("usage: BAS sample node_id spike_time spike_value node_id1 spike_time1 spike_value1 ...\n");
+          } else {
+            for (i = 0; i < (sv.size() - 2) / 3; i++) {
+              try {
+                if (sscanf(sv[i*3 + 2].c_str(), "%d", &spike_id) != 1 ||
+                    sscanf(sv[i*3 + 3].c_str(), "%lf", &spike_time) != 1 ||
+                    sscanf(sv[i*3 + 4].c_str(), "%lf", &spike_val) != 1 ) {
+
+                  throw SRE((string) "Invalid spike [ " + sv[i*3 + 2] + "," + sv[i*3 + 3] + "," +
+                                       sv[i*3 + 4] + "]\n");
+                }
+                spike_validation(Spike(spike_id, spike_time, spike_val), net, true);
+                vp->apply_batch_spike(Spike(net->get_node(spike_id)->input_id, spike_time, spike_val), sample);
+
+              } catch (const SRE &e) {
+                printf("%s\n",e.what());
+              }
+            }
+          }
+        }
+
+      } else if (sv[0] == "BRUN") { // run_batch()
+
+        if (network_processor_validation(net, p)) {
+          vp = dynamic_cast <vrisp::Processor *> (p);
+          if (sv.size() != 2 || sscanf(sv[1].c_str(), "%lf", &sim_time) != 1 || sim_time < 0) {
+            printf("usage: BRUN sim_time. sim_time >= 0\n");
+          } else {
+            vp->run_batch(sim_time);
+          }
+        }
+
+      } else if (sv[0] == "BOC" || sv[0] == "BOLF" || sv[0] == "BNCH") { // batch_output_counts() etc.
+
+        if (network_processor_validation(net, p)) {
+          vp = dynamic_cast <vrisp::Processor *> (p);
+          if (sv.size() != 2 || sscanf(sv[1].c_str(), "%zu", &sample) != 1) {
+            printf("usage: %s sample\n", sv[0].c_str());
+          } else if (sv[0] == "BOC") {
+            event_counts = vp->batch_output_counts(sample);
+            for (i = 0; i < (size_t)net->num_outputs(); i++) {
+              node = net->get_output(i);
+              printf("node %s spike counts: %d\n", node_name(node).c_str(), event_counts[i]);
+            }
+          } else if (sv[0] == "BOLF") {
+            output_times = vp->batch_output_last_fires(sample);
+            for (i = 0; i < (size_t)net->num_outputs(); i++) {
+              node = net->get_output(i);
+              printf("node %s last fire time: %.1lf\n", node_name(node).c_str(), output_times[i]);
+            }
+          } else {
+            net->make_sorted_node_vector();
+            charges = vp->batch_neuron_charges(sample);
+            for (i = 0; i < charges.size(); i++) {
+              node = net->sorted_node_vector[i];
+              printf("Node %*s charge: %lg\n", max_name_len, node_name(node).c_str(), charges[i]);
+            }
+          }
+        }
+
+      } else if (sv[0] == "BCA") { // clear_batch_activity()
+
+        if (network_processor_validation(net, p)) {
+          vp = dynamic_cast <vrisp::Processor *> (p);
+          vp->clear_batch_activity();
+        }
+
+#endif
       } else if (sv[0] == "CA" || sv[0] == "CLEAR-A") { // clear_activity
   
         if (network_processor_validation(net, p)) 
@@ -28,6 +28,7 @@ static json risp_spec = {
   { "inputs_from_weights", "B"},
   { "noisy_seed", "I" },
   { "stds", "A"},
+  { "network_cache", "I" },
     { "Necessary", { "max_delay", 
                      "min_threshold",
                      "max_threshold",
@@ -43,7 +44,8 @@ Neuron::Neuron(uint32_t node_id, double t, bool l)
     fire_counts(0),
     leak(l),
     id(node_id),
-    check(false) {};
+    check(false),
+    track(false) {};
 
 Synapse::Synapse(double w, uint32_t d, Neuron* to_n) : weight(w), to(to_n), delay(d) {};
 
@@ -71,8 +73,9 @@ Network::Network(neuro::Network *net,
 
   size_t i;
   neuro::Node *node;
-  neuro::Edge *edge;
-  EdgeMap::iterator eit;
+  const neuro::Network *cnet;
+  const neuro::Edge *edge;
+  EdgeMap::const_iterator eit;
   Neuron *n;
   leak_mode = leak;
   bool neuron_leak;
@@ -112,13 +115,47 @@ Network::Network(neuro::Network *net,
     sorted_neuron_vector.push_back(n);
   }
 
-  /* Add synpases */
-  for (eit = net->edges_begin(); eit != net->edges_end(); ++eit) {
+  /* Add synpases.  These are read through a const network, so that a copy which
+     shares its nodes and edges with another network keeps sharing them. */
+  cnet = net;
+  for (eit = cnet->edges_begin(); eit != cnet->edges_end(); ++eit) {
     edge = eit->second.get();
     add_synpase(edge->from->id, edge->to->id, edge->get("Weight"), edge->get("Delay"));
   }
 }
 
+/* The copy constructor copies the settings, and the pointers to the neurons.  We then
+   replace the neurons with copies, and point the synapses at them. */
+
+Network* Network::clone() const
+{
+  Network *rv;
+  Neuron *n;
+  size_t i, j;
+  Synapse *s;
+
+  rv = new Network(*this);
+  rv->neuron_map.clear();
+  for (i = 0; i < sorted_neuron_vector.size(); i++) {
+    n = new Neuron(*sorted_neuron_vector[i]);
+    n->track = false;
+    rv->neuron_map[n->id] = n;
+    rv->sorted_neuron_vector[i] = n;
+  }
+  for (i = 0; i < rv->sorted_neuron_vector.size(); i++) {
+    n = rv->sorted_neuron_vector[i];
+    for (j = 0; j < n->synapses.size(); j++) {
+      s = n->synapses[j];
+      n->synapses[j] = new Synapse(s->weight, s->delay, rv->neuron_map[s->to->id]);
+    }
+  }
+  rv->clear_activity();
+  rv->neuron_fire_counter = 0;
+  rv->neuron_accum_counter = 0;
+  rv->rng.Seed(noisy_seed, "noisy_risp");
+  return rv;
+}
+
 Neuron* Network::get_neuron(uint32_t node_id) 
 {
   unordered_map <uint32_t, Neuron*>::const_iterator it;
@@ -672,6 +709,7 @@ Processor::Processor(json &params)
   noisy_seed = 0;
   noisy_stddev = 0;
   inputs_from_weights = false;
+  network_cache = 0;
 
   /* You don't have to check for these, because they are required in the JSON. */
 
@@ -759,6 +797,12 @@ Processor::Processor(json &params)
   if (params.contains("stds")) stds = params["stds"].get< vector <double> >(); 
   if (params.contains("noisy_stddev")) noisy_stddev = params["noisy_stddev"]; 
 
+  if (params.contains("network_cache")) {
+    if (params["network_cache"] < 0) throw SRE("Reading processor json - network_cache must be >= 0");
+    network_cache = params["network_cache"];
+  }
+  template_cache.set_capacity(network_cache);
+
   if (leak_mode != "all" && leak_mode != "none" && leak_mode != "configurable") {
     throw SRE("Reading processor json - bad leak_mode.  Must be all, none or configurable");
   }
@@ -824,6 +868,7 @@ Processor::Processor(json &params)
   if (noisy_seed != 0) saved_params["noisy_seed"] = noisy_seed;
   if (noisy_stddev != 0) saved_params["noisy_stddev"] = noisy_stddev;
   if (stds.size() != 0) saved_params["stds"] = stds;
+  if (network_cache != 0) saved_params["network_cache"] = network_cache;
 
 };
 
@@ -839,6 +884,8 @@ Processor::~Processor(){
 bool Processor::load_network(neuro::Network* net, int network_id) {
 
   risp::Network *risp_net;
+  shared_ptr <risp::Network> t;
+  uint64_t key;
   string error;
   string rln = "risp::load_network() - ";
 
@@ -863,6 +910,18 @@ bool Processor::load_network(neuro::Network* net, int network_id) {
 
   if (networks.find(network_id) != networks.end()) delete networks[network_id];
 
+  /* If we've seen this network before, clone the template that we made from it.
+     Otherwise, make the network, and keep a template for next time. */
+
+  if (network_cache > 0) {
+    key = net->content_hash();
+    t = template_cache.get(key);
+    if (t != nullptr) {
+      networks[network_id] = t->clone();
+      return true;
+    }
+  }
+
   risp_net = new risp::Network(net, 
                                spike_value_factor,
                                min_potential,
@@ -877,6 +936,7 @@ bool Processor::load_network(neuro::Network* net, int network_id) {
                                weights,
                                stds);
   networks[network_id] = risp_net;
+  if (network_cache > 0) template_cache.put(key, shared_ptr <risp::Network> (risp_net->clone()));
 
   return true;
 }
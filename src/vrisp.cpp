@@ -2,9 +2,14 @@
 #include "framework.hpp"
 #include "utils/alignment_helpers.hpp"
 #include "utils/json_helpers.hpp"
+#include <algorithm>
+#include <condition_variable>
 #include <cstddef>
 #include <cstdint>
+#include <functional>
+#include <mutex>
 #include <stdexcept>
+#include <thread>
 #if defined(RISCVV_FULL) || defined(RISCVV_FIRED) || defined(RISCVV_SYNAPSES)
 #include <riscv_vector.h>
 #endif
@@ -24,6 +29,12 @@ static json vrisp_spec = {
     {"tracked_timesteps", "I"},
     {"leak_mode", "S"},
     {"spike_value_factor", "D"},
+    {"sort_synapses", "B"},
+    {"frontier_density", "D"},
+    {"threads", "I"},
+    {"power_of_two_timesteps", "B"},
+    {"pack_networks", "B"},
+    {"network_cache", "I"},
     {"Necessary",
      {"min_weight", "max_weight", "max_delay", "min_threshold", "max_threshold",
       "min_potential", "tracked_timesteps"}},
@@ -36,58 +47,224 @@ static inline bool is_integer(double v) {
     return (iv == v);
 }
 
-#if defined(RISCVV_FIRED) || defined(RISCVV_FULL)
 static bool get_fired(const uint8_t* fired_vec, size_t index) {
     return ((fired_vec[index / 8]) >> (index % 8)) & 1;
 }
-#endif
 
-#if defined(NO_SIMD) || defined(RISCVV_SYNAPSES)
+static void set_fired(uint8_t* fired_vec, size_t index) {
+    fired_vec[index / 8] |= 1 << (index % 8);
+}
+
 static bool
 get_leak(const vector<uint8_t, AlignmentAllocator<uint8_t>>& leak_vec,
          size_t index) {
     return ((leak_vec[index / 8]) >> (index % 8)) & 1;
 }
-#endif
 
 static void set_leak(vector<uint8_t, AlignmentAllocator<uint8_t>>& leak_vec,
                      size_t index) {
     leak_vec[index / 8] |= 1 << (index % 8);
 }
 
+/** Used to sort a neuron's synapses by delay, then by destination. */
+struct SortedSynapse {
+    uint8_t delay;
+    uint32_t to;
+    int8_t weight;
+};
+
+/** Threads in threaded mode meet here twice per timestep. C++11 has no
+ * std::barrier, so this is the usual mutex and condition variable one. */
+class Barrier {
+  public:
+    explicit Barrier(size_t count) : count(count), waiting(0), generation(0) {}
+
+    void wait() {
+        unique_lock<mutex> lock(m);
+        size_t gen = generation;
+
+        if (++waiting == count) {
+            waiting = 0;
+            generation++;
+            cv.notify_all();
+        } else {
+            cv.wait(lock, [this, gen] { return gen != generation; });
+        }
+    }
+
+  private:
+    mutex m;
+    condition_variable cv;
+    size_t count;
+    size_t waiting;
+    size_t generation;
+};
+
+/** The threads of threaded mode, started with the network. Between runs they
+ * wait at `start`, so a control loop that calls run(1) pays for two barrier
+ * waits per timestep rather than for starting and joining threads. The
+ * calling thread is thread 0. */
+class WorkerPool {
+  public:
+    explicit WorkerPool(size_t count)
+        : start(count), finish(count), phase(count), job(nullptr),
+          stopping(false) {
+        for (size_t p = 1; p < count; p++) {
+            threads.push_back(thread(&WorkerPool::work, this, p));
+        }
+    }
+
+    ~WorkerPool() {
+        stopping = true;
+        start.wait();
+        for (size_t p = 0; p < threads.size(); p++) {
+            threads[p].join();
+        }
+    }
+
+    /** Calls j(p) on every thread, and returns when they have all finished */
+    void run(const function<void(size_t)>& j) {
+        job = &j;
+        start.wait();
+        j(0);
+        finish.wait();
+        job = nullptr;
+    }
+
+    /** Separates the phases of a timestep, called by every thread */
+    void sync() { phase.wait(); }
+
+  private:
+    void work(size_t p) {
+        while (true) {
+            start.wait();
+            if (stopping) {
+                return;
+            }
+            (*job)(p);
+            finish.wait();
+        }
+    }
+
+    Barrier start;
+    Barrier finish;
+    Barrier phase;
+    const function<void(size_t)>* job;
+    bool stopping;
+    vector<thread> threads;
+};
+
+static bool sorted_synapse_comp(const SortedSynapse& a,
+                                const SortedSynapse& b) {
+    if (a.delay != b.delay) {
+        return a.delay < b.delay;
+    }
+    return a.to < b.to;
+}
+
+/** The number of synapses that the vector kernels gather and scatter at once.
+ * The scalar kernels deliver one synapse at a time. */
+static size_t synapse_chunk() {
+#if defined(RISCVV_FULL) || defined(RISCVV_SYNAPSES)
+    return __riscv_vsetvlmax_e8m1();
+#else
+    return 1;
+#endif
+}
+
+template <bool POW2> size_t Network::ring_row(size_t timestep) const {
+    return POW2 ? (timestep & (tracked_timesteps_count - 1))
+                : (timestep % tracked_timesteps_count);
+}
+
+/** Picks the instantiations of process_dense() and process_partition() that
+ * match this network's settings. */
+void Network::select_kernels() {
+    static const DenseKernel dense_kernels[3][2][2] = {
+        {{&Network::process_dense<'a', false, false>,
+          &Network::process_dense<'a', false, true>},
+         {&Network::process_dense<'a', true, false>,
+          &Network::process_dense<'a', true, true>}},
+        {{&Network::process_dense<'n', false, false>,
+          &Network::process_dense<'n', false, true>},
+         {&Network::process_dense<'n', true, false>,
+          &Network::process_dense<'n', true, true>}},
+        {{&Network::process_dense<'c', false, false>,
+          &Network::process_dense<'c', false, true>},
+         {&Network::process_dense<'c', true, false>,
+          &Network::process_dense<'c', true, true>}},
+    };
+    static const PartitionKernel partition_kernels[3][2][2] = {
+        {{&Network::process_partition<'a', false, false>,
+          &Network::process_partition<'a', false, true>},
+         {&Network::process_partition<'a', true, false>,
+          &Network::process_partition<'a', true, true>}},
+        {{&Network::process_partition<'n', false, false>,
+          &Network::process_partition<'n', false, true>},
+         {&Network::process_partition<'n', true, false>,
+          &Network::process_partition<'n', true, true>}},
+        {{&Network::process_partition<'c', false, false>,
+          &Network::process_partition<'c', false, true>},
+         {&Network::process_partition<'c', true, false>,
+          &Network::process_partition<'c', true, true>}},
+    };
+    int leak = (leak_mode == 'a') ? 0 : ((leak_mode == 'n') ? 1 : 2);
+    int zero_min = (min_potential == 0);
+    int pow2 = ring_is_power_of_two;
+
+    dense_kernel = dense_kernels[leak][zero_min][pow2];
+    partition_kernel = partition_kernels[leak][zero_min][pow2];
+}
+
+Network::Network(shared_ptr<Topology> t)
+    : topology(t), inputs(t->inputs), outputs(t->outputs),
+      input_mappings(t->input_mappings), output_mappings(t->output_mappings),
+      neuron_mappings(t->neuron_mappings),
+      neuron_threshold(t->neuron_threshold),
+      synapse_offsets(t->synapse_offsets), synapse_to(t->synapse_to),
+      synapse_delay(t->synapse_delay), synapse_weight(t->synapse_weight),
+      synapse_serial(t->synapse_serial), neuron_leak(t->neuron_leak),
+      always_active(t->always_active) {}
+
 Network::Network(neuro::Network* net, double _min_potential, char leak,
-                 size_t tracked_timesteps, double _spike_value_factor) {
+                 size_t tracked_timesteps, double _spike_value_factor,
+                 bool sort_synapses, double frontier_density, size_t threads)
+    : Network(make_shared<Topology>()) {
     leak_mode = leak;
-    spike_value_factor = _spike_value_factor;
-    tracked_timesteps_count = tracked_timesteps;
+    build_topology(net, sort_synapses);
+    init_state(_min_potential, leak, tracked_timesteps, _spike_value_factor,
+               frontier_density, threads);
+}
 
-    min_potential = _min_potential;
-    current_timestep = 0;
+Network::Network(shared_ptr<Topology> t, double _min_potential, char leak,
+                 size_t tracked_timesteps, double _spike_value_factor,
+                 double frontier_density, size_t threads)
+    : Network(t) {
+    init_state(_min_potential, leak, tracked_timesteps, _spike_value_factor,
+               frontier_density, threads);
+}
+
+shared_ptr<Topology> Network::get_topology() const { return topology; }
+
+/** Fills in the topology from the framework network. leak_mode must be set. */
+void Network::build_topology(neuro::Network* net, bool sort_synapses) {
+    /* The rest is read through a const network, so that a copy which shares
+       its nodes and edges with another network keeps sharing them. */
+    const neuro::Network* cnet = net;
 
     net->make_sorted_node_vector();
 
-    neuron_count = net->sorted_node_vector.size() != 0
-                       ? net->sorted_node_vector.back()->id + 1
-                       : 0;
+    /* Neurons are indexed densely, in node id order, so that sparse node ids
+       do not cost memory or time. neuron_mappings translates an index back
+       to its node id, and neuron_index() goes the other way. */
+    neuron_count = net->sorted_node_vector.size();
     allocation_size = ((neuron_count + 15) / 16) *
                       16; // JDM Instead of messing with masking load/stores we
                           // can just round up to a multiple of 16
 
     inputs.resize(allocation_size);
     outputs.resize(allocation_size);
-
-    output_fire_count.resize(allocation_size, 0);
-    output_last_fire_timestep.resize(allocation_size, -1);
     neuron_threshold.resize(allocation_size, INT8_MAX);
-    synapse_to.resize(allocation_size);
-    synapse_delay.resize(allocation_size);
-    synapse_weight.resize(allocation_size);
-    neuron_charge_buffer = (int8_t*)aligned_alloc(
-        16, sizeof(*neuron_charge_buffer) * tracked_timesteps_count *
-                allocation_size);
-    memset(neuron_charge_buffer, 0,
-           sizeof(*neuron_charge_buffer) * tracked_timesteps_count *
-               allocation_size);
     neuron_leak.resize(allocation_size / 8);
 
     /* Add neurons */
@@ -98,47 +275,283 @@ Network::Network(neuro::Network* net, double _min_potential, char leak,
 
         if (leak_mode == 'c') {
             if (node->get("Leak") != 0) {
-                set_leak(neuron_leak, node->id);
+                set_leak(neuron_leak, i);
             }
         } else {
             if (leak_mode == 'a') {
-                set_leak(neuron_leak, node->id);
+                set_leak(neuron_leak, i);
             }
         }
 
-        neuron_threshold[node->id] = node->get("Threshold");
+        neuron_threshold[i] = node->get("Threshold");
 
         if (node->is_input()) {
-            inputs[node->id] = true;
+            inputs[i] = true;
         }
 
         if (node->is_output()) {
-            outputs[node->id] = true;
+            outputs[i] = true;
         }
     }
 
     for (int i = 0; i < net->num_inputs(); i++) {
-        input_mappings.push_back(net->get_input(i)->id);
+        input_mappings.push_back(neuron_index(cnet->get_input(i)->id));
     }
 
     for (int i = 0; i < net->num_outputs(); i++) {
-        output_mappings.push_back(net->get_output(i)->id);
+        output_mappings.push_back(neuron_index(cnet->get_output(i)->id));
+    }
+
+    /* Add synapses. They are stored in CSR form: first count each neuron's
+       fan-out to compute the offsets, then place each synapse into its
+       neuron's range. This is one allocation per field, rather than one per
+       neuron per field. */
+    synapse_offsets.resize(allocation_size + 1, 0);
+    for (EdgeMap::const_iterator eit = cnet->edges_begin();
+         eit != cnet->edges_end(); ++eit) {
+        synapse_offsets[neuron_index(eit->second->from->id) + 1]++;
+    }
+    for (size_t i = 0; i < allocation_size; i++) {
+        synapse_offsets[i + 1] += synapse_offsets[i];
     }
 
-    /* Add synapses */
-    for (EdgeMap::iterator eit = net->edges_begin(); eit != net->edges_end();
-         ++eit) {
-        neuro::Edge* edge = eit->second.get();
+    synapse_to.resize(net->num_edges());
+    synapse_delay.resize(net->num_edges());
+    synapse_weight.resize(net->num_edges());
 
-        synapse_to[edge->from->id].push_back(edge->to->id);
-        synapse_delay[edge->from->id].push_back(edge->get("Delay"));
-        synapse_weight[edge->from->id].push_back(edge->get("Weight"));
+    vector<uint32_t> next_slot(synapse_offsets.begin(),
+                               synapse_offsets.end() - 1);
+    const int delay_index = net->get_edge_property("Delay")->index;
+    const int weight_index = net->get_edge_property("Weight")->index;
+
+    for (EdgeMap::const_iterator eit = cnet->edges_begin();
+         eit != cnet->edges_end(); ++eit) {
+        const neuro::Edge* edge = eit->second.get();
+        uint32_t slot = next_slot[neuron_index(edge->from->id)]++;
+
+        synapse_to[slot] = neuron_index(edge->to->id);
+        synapse_delay[slot] = edge->get(delay_index);
+        synapse_weight[slot] = edge->get(weight_index);
     }
+
+    /* Optionally sort each neuron's synapses by delay, then by destination, so
+       that firing a neuron walks the charge buffer one row at a time. */
+    if (sort_synapses) {
+        vector<SortedSynapse> entries;
+
+        for (size_t i = 0; i < neuron_count; i++) {
+            uint32_t start = synapse_offsets[i];
+            uint32_t end = synapse_offsets[i + 1];
+
+            if (end - start < 2) {
+                continue;
+            }
+            entries.resize(end - start);
+            for (uint32_t j = start; j < end; j++) {
+                entries[j - start].delay = synapse_delay[j];
+                entries[j - start].to = synapse_to[j];
+                entries[j - start].weight = synapse_weight[j];
+            }
+            sort(entries.begin(), entries.end(), sorted_synapse_comp);
+            for (uint32_t j = start; j < end; j++) {
+                synapse_delay[j] = entries[j - start].delay;
+                synapse_to[j] = entries[j - start].to;
+                synapse_weight[j] = entries[j - start].weight;
+            }
+        }
+    }
+
+    synapse_serial.resize(allocation_size, false);
+    separate_synapse_conflicts(synapse_chunk());
+
+    /* Neurons that frontier mode must visit even when nothing touches them */
+    for (size_t i = 0; i < neuron_count; i++) {
+        if (neuron_threshold[i] <= 0) {
+            always_active.push_back(i);
+        }
+    }
+}
+
+/** For BatchNetwork, which keeps its own state: the topology and the
+ * settings, without the charge buffer and the rest of the state that running
+ * one sample needs. */
+Network::Network(neuro::Network* net, double _min_potential, char leak,
+                 size_t tracked_timesteps, double _spike_value_factor)
+    : Network(make_shared<Topology>()) {
+    leak_mode = leak;
+    build_topology(net, false);
+    init_settings(_min_potential, leak, tracked_timesteps, _spike_value_factor);
+}
+
+/** Sets the parameters that every network has, and leaves the state empty. */
+void Network::init_settings(double _min_potential, char leak,
+                            size_t tracked_timesteps,
+                            double _spike_value_factor) {
+    leak_mode = leak;
+    spike_value_factor = _spike_value_factor;
+    tracked_timesteps_count = tracked_timesteps;
+
+    /* Charges are int8_t, so a min_potential below INT8_MIN never clamps
+       anything. Saturating keeps it that way, where a plain conversion would
+       wrap it to a positive floor. */
+    min_potential = _min_potential;
+    min_potential_charge = (int8_t)max(min_potential, (double)INT8_MIN);
+    current_timestep = 0;
+    ring_is_power_of_two =
+        ((tracked_timesteps_count & (tracked_timesteps_count - 1)) == 0);
+    select_kernels();
+
+    neuron_count = neuron_mappings.size();
+    allocation_size = ((neuron_count + 15) / 16) * 16;
+
+    tracked_neuron_count = 0;
+    neuron_fire_counter = 0;
+    neuron_accum_counter = 0;
+    neuron_charge_buffer = nullptr;
+    frontier_enabled = false;
+    frontier_limit = 0;
+    thread_count = 1;
+    partition_size = allocation_size;
+}
+
+/** Sets up everything that running the network changes. */
+void Network::init_state(double _min_potential, char leak,
+                         size_t tracked_timesteps, double _spike_value_factor,
+                         double frontier_density, size_t threads) {
+    init_settings(_min_potential, leak, tracked_timesteps, _spike_value_factor);
+
+    output_fire_count.resize(allocation_size, 0);
+    output_last_fire_timestep.resize(allocation_size, -1);
+    neuron_tracked.resize(allocation_size, false);
+    fired_bitmap.resize(allocation_size / 8, 0);
+    neuron_charge_buffer = (int8_t*)aligned_alloc(
+        16, sizeof(*neuron_charge_buffer) * tracked_timesteps_count *
+                allocation_size);
+    memset(neuron_charge_buffer, 0,
+           sizeof(*neuron_charge_buffer) * tracked_timesteps_count *
+               allocation_size);
+
+    /* Frontier mode: rows touched by few neurons are processed sparsely. */
+    frontier_enabled = (frontier_density > 0);
+    frontier_limit = frontier_density * neuron_count;
+    if (frontier_enabled) {
+        frontier.resize(tracked_timesteps_count);
+        frontier_touched.resize(tracked_timesteps_count * allocation_size / 8,
+                                0);
+        frontier_dense.resize(tracked_timesteps_count, 0);
+    }
+
+    /* Threaded mode: each thread owns a contiguous range of neurons. Ranges
+       are multiples of 16, so that threads never share a byte of a bitmap. */
+    thread_count = threads;
+    partition_size = ((neuron_count + thread_count - 1) / thread_count + 15) /
+                     16 * 16;
+    if (partition_size == 0) {
+        partition_size = 16;
+    }
+    if (thread_count > 1) {
+        outboxes.resize(thread_count,
+                        vector<vector<Delivery>>(thread_count));
+        pool.reset(new WorkerPool(thread_count));
+    }
+
+    /* Each partition keeps its own accumulates, so record_fires() can run on
+       every thread at once. The serial path is partition 0. */
+    pending_accumulates.resize(thread_count * tracked_timesteps_count, 0);
 }
 
 Network::~Network() { free(neuron_charge_buffer); }
 
-void Network::apply_spike(const Spike& s, bool normalized) {
+/** A vector kernel gathers the charges of a chunk of synapses, adds their
+ * weights and scatters them back, so if two synapses in a chunk hit the same
+ * charge buffer slot -- the same delay and destination -- one of the updates
+ * is lost. This reorders the synapses of each neuron so that no chunk holds
+ * such a pair. Equal pairs are grouped, the groups are ordered from largest to
+ * smallest, and the synapses are laid out in blocks: the first synapse of every
+ * group, then the second synapse of every group that has one, and so on. Each
+ * block is a prefix of the previous one, so the two copies of a pair are
+ * exactly one block apart, and they land in different chunks as long as every
+ * block but the last holds at least `chunk` synapses. When that fails, the
+ * neuron is marked in synapse_serial, and the kernels deliver its synapses one
+ * at a time. */
+void Network::separate_synapse_conflicts(size_t chunk) {
+    vector<SortedSynapse> entries;
+    vector<SortedSynapse> placed;
+    vector<pair<size_t, size_t>> groups; /**< (size, first entry) */
+
+    if (chunk < 2) {
+        return;
+    }
+
+    for (size_t i = 0; i < neuron_count; i++) {
+        uint32_t start = synapse_offsets[i];
+        uint32_t end = synapse_offsets[i + 1];
+        size_t block_start;
+        bool duplicates = false;
+
+        if (end - start < 2) {
+            continue;
+        }
+        entries.resize(end - start);
+        for (uint32_t j = start; j < end; j++) {
+            entries[j - start].delay = synapse_delay[j];
+            entries[j - start].to = synapse_to[j];
+            entries[j - start].weight = synapse_weight[j];
+        }
+        stable_sort(entries.begin(), entries.end(), sorted_synapse_comp);
+
+        groups.clear();
+        for (size_t j = 0; j < entries.size(); j++) {
+            if (j > 0 && !sorted_synapse_comp(entries[j - 1], entries[j])) {
+                groups.back().first++;
+                duplicates = true;
+            } else {
+                groups.push_back(make_pair((size_t)1, j));
+            }
+        }
+
+        /* The common case: a neuron has one synapse per destination. */
+        if (!duplicates) {
+            continue;
+        }
+
+        stable_sort(groups.begin(), groups.end(),
+                    [](const pair<size_t, size_t>& a,
+                       const pair<size_t, size_t>& b) {
+                        return a.first > b.first;
+                    });
+
+        placed.clear();
+        for (size_t r = 0; r < groups[0].first; r++) {
+            block_start = placed.size();
+            for (size_t g = 0; g < groups.size() && groups[g].first > r; g++) {
+                placed.push_back(entries[groups[g].second + r]);
+            }
+            if (r + 1 < groups[0].first &&
+                placed.size() - block_start < chunk) {
+                synapse_serial[i] = true;
+                break;
+            }
+        }
+        if (synapse_serial[i]) {
+            continue;
+        }
+
+        for (uint32_t j = start; j < end; j++) {
+            synapse_delay[j] = placed[j - start].delay;
+            synapse_to[j] = placed[j - start].to;
+            synapse_weight[j] = placed[j - start].weight;
+        }
+    }
+}
+
+/** Checks a spike and returns the charge that it adds. */
+int32_t Network::spike_charge(const Spike& s, bool normalized) const {
+    if (s.id < 0 || (size_t)s.id >= input_mappings.size()) {
+        throw SRE("vrisp::Network::apply_spike() - input " + to_string(s.id) +
+                  " does not exist.");
+    }
+
     if (!normalized && !is_integer(s.value)) {
         throw SRE("vrisp::Network::apply_spike() only supports integer spike"
                   "values - value (" +
@@ -157,12 +570,107 @@ void Network::apply_spike(const Spike& s, bool normalized) {
                   to_string(tracked_timesteps_count) + ")");
     }
 
-    int32_t spike_value = (normalized) ? s.value * spike_value_factor : s.value;
+    return (normalized) ? s.value * spike_value_factor : s.value;
+}
+
+void Network::apply_spike(const Spike& s, bool normalized) {
+    int32_t spike_value = spike_charge(s, normalized);
+    size_t row = (current_timestep + (size_t)s.time) % tracked_timesteps_count;
+
+    neuron_charge_buffer[row * allocation_size + input_mappings[s.id]] +=
+        spike_value;
+    pending_accumulates[row]++;
+    if (frontier_enabled) {
+        frontier_touch(row, input_mappings[s.id]);
+    }
+}
+
+/** Bulk spikes are validated as they are queued, so a bad spike throws
+ * before any of them are applied. */
+void Network::apply_spikes(const vector<Spike>& s, bool normalized) {
+    spike_queue.clear();
+    for (size_t i = 0; i < s.size(); i++) {
+        queue_spike(s[i], normalized);
+    }
+    flush_spikes();
+}
+
+void Network::apply_spikes(const vector<int>& input_ids,
+                           const vector<double>& times,
+                           const vector<double>& values, bool normalized) {
+    if (times.size() != input_ids.size() || values.size() != input_ids.size()) {
+        throw SRE("vrisp::Network::apply_spikes() - input_ids, times and "
+                  "values must be the same size.");
+    }
+
+    spike_queue.clear();
+    for (size_t i = 0; i < input_ids.size(); i++) {
+        queue_spike(Spike(input_ids[i], times[i], values[i]), normalized);
+    }
+    flush_spikes();
+}
+
+void Network::queue_spike(const Spike& s, bool normalized) {
+    int32_t spike_value = spike_charge(s, normalized);
+    size_t row = (current_timestep + (size_t)s.time) % tracked_timesteps_count;
+
+    spike_queue.push_back(
+        make_pair(row * allocation_size + input_mappings[s.id], spike_value));
+}
+
+/** Sorting the queue by slot merges the spikes that hit the same input on the
+ * same timestep into one add. Adding up int8_t charges wraps the same way in
+ * either order, so this matches applying them one at a time. The slots left
+ * are distinct, so the vector build adds them with one gather and scatter per
+ * vector. */
+void Network::flush_spikes() {
+    size_t n = 0;
+
+    for (size_t i = 0; i < spike_queue.size(); i++) {
+        pending_accumulates[spike_queue[i].first / allocation_size]++;
+    }
+
+    sort(spike_queue.begin(), spike_queue.end());
+    spike_slots.resize(spike_queue.size());
+    spike_charges.resize(spike_queue.size());
+    for (size_t i = 0; i < spike_queue.size(); i++) {
+        if (n > 0 && spike_slots[n - 1] == spike_queue[i].first) {
+            spike_charges[n - 1] += spike_queue[i].second;
+        } else {
+            spike_slots[n] = spike_queue[i].first;
+            spike_charges[n] = spike_queue[i].second;
+            n++;
+        }
+    }
+
+    if (frontier_enabled) {
+        for (size_t i = 0; i < n; i++) {
+            frontier_touch(spike_slots[i] / allocation_size,
+                           spike_slots[i] % allocation_size);
+        }
+    }
 
-    neuron_charge_buffer[((current_timestep + (size_t)s.time) %
-                          tracked_timesteps_count) *
-                             allocation_size +
-                         input_mappings[s.id]] += spike_value;
+#if defined(RISCVV_FULL) || defined(RISCVV_FIRED) || defined(RISCVV_SYNAPSES)
+    for (size_t i = 0; i < n;) {
+        size_t vector_length = __riscv_vsetvl_e8m1(n - i);
+
+        vuint32m4_t slots =
+            __riscv_vle32_v_u32m4(&spike_slots[i], vector_length);
+        vint8m1_t charges =
+            __riscv_vle8_v_i8m1(&spike_charges[i], vector_length);
+        vint8m1_t buffered = __riscv_vluxei32_v_i8m1(neuron_charge_buffer,
+                                                     slots, vector_length);
+
+        buffered = __riscv_vadd_vv_i8m1(buffered, charges, vector_length);
+        __riscv_vsuxei32_v_i8m1(neuron_charge_buffer, slots, buffered,
+                                vector_length);
+        i += vector_length;
+    }
+#else
+    for (size_t i = 0; i < n; i++) {
+        neuron_charge_buffer[spike_slots[i]] += spike_charges[i];
+    }
+#endif
 }
 
 void Network::run(size_t duration) {
@@ -170,8 +678,19 @@ void Network::run(size_t duration) {
         clear_output_tracking();
     }
 
-    for (size_t i = 0; i < duration; i++) {
-        process_events(i);
+    if (thread_count > 1) {
+        run_threaded(duration);
+    } else {
+        uint8_t* history = extend_fire_history(duration);
+
+        for (size_t i = 0; i < duration; i++) {
+            process_events(i);
+            record_fires((current_timestep + i) % tracked_timesteps_count, 0,
+                         (history == nullptr)
+                             ? nullptr
+                             : history + i * fired_bitmap.size(),
+                         neuron_fire_counter, neuron_accum_counter);
+        }
     }
 
     current_timestep += duration;
@@ -187,50 +706,38 @@ void Network::run(size_t duration) {
     }
 }
 
+/** Delivers neuron i's synapses one at a time, for the vector kernels, when
+ * the neuron is in synapse_serial. */
+void Network::deliver_serial(size_t i, size_t row) {
+    for (size_t k = synapse_offsets[i]; k < synapse_offsets[i + 1]; k++) {
+        neuron_charge_buffer[((row + synapse_delay[k]) %
+                              tracked_timesteps_count) *
+                                 allocation_size +
+                             synapse_to[k]] += synapse_weight[k];
+    }
+}
+
 void Network::process_events(uint32_t time) {
 
     size_t internal_timestep =
         (current_timestep + time) % tracked_timesteps_count;
 
-#ifdef NO_SIMD
-    for (size_t i = 0; i < neuron_count; i++) {
-        if (neuron_charge_buffer[internal_timestep * allocation_size + i] <
-            min_potential) {
-            neuron_charge_buffer[internal_timestep * allocation_size + i] =
-                min_potential;
+    if (frontier_enabled) {
+        for (size_t i = 0; i < always_active.size(); i++) {
+            frontier_touch(internal_timestep, always_active[i]);
         }
-        if (neuron_charge_buffer[internal_timestep * allocation_size + i] >=
-            neuron_threshold[i]) {
-            for (size_t j = 0; j < synapse_to[i].size(); j++) {
-                neuron_charge_buffer[((internal_timestep +
-                                       synapse_delay[i][j]) %
-                                      tracked_timesteps_count) *
-                                         allocation_size +
-                                     synapse_to[i][j]] += synapse_weight[i][j];
-            }
-
-            // Track output count and last fire time
-            if (outputs[i]) {
-                output_last_fire_timestep[i] = time;
-                output_fire_count[i]++;
-            }
-        } else {
-            if (!get_leak(neuron_leak, i)) {
-                // If we don't leak we carry this charge over into the next
-                // timestep
-                neuron_charge_buffer[(internal_timestep + 1) %
-                                         tracked_timesteps_count *
-                                         allocation_size +
-                                     i] +=
-                    neuron_charge_buffer[internal_timestep * allocation_size +
-                                         i];
-            }
+        if (!frontier_dense[internal_timestep]) {
+            process_frontier(time, internal_timestep);
+            return;
         }
     }
 
+#ifdef NO_SIMD
+    (this->*dense_kernel)(time, internal_timestep);
 #endif // NO_SIMD
 #ifdef RISCVV_FULL
     const size_t max_vector_length = __riscv_vsetvlmax_e8m1();
+    const size_t next_row = (internal_timestep + 1) % tracked_timesteps_count;
     for (size_t i = 0; i < neuron_count; i += max_vector_length) {
         size_t vector_length = min(max_vector_length, neuron_count - i);
 
@@ -238,7 +745,7 @@ void Network::process_events(uint32_t time) {
             &neuron_charge_buffer[(internal_timestep * allocation_size) + i],
             vector_length);
         vint8m1_t min_potential_vec =
-            __riscv_vmv_v_x_i8m1(min_potential, vector_length);
+            __riscv_vmv_v_x_i8m1(min_potential_charge, vector_length);
         charges =
             __riscv_vmax_vv_i8m1(charges, min_potential_vec, vector_length);
         vint8m1_t thresholds =
@@ -247,6 +754,8 @@ void Network::process_events(uint32_t time) {
         vbool8_t fired =
             __riscv_vmsge_vv_i8m1_b8(charges, thresholds, vector_length);
 
+        __riscv_vsm_v_b8(&fired_bitmap[i / 8], fired, vector_length);
+
         if (leak_mode != 'a') {
             vbool8_t leak =
                 __riscv_vlm_v_b8(&neuron_leak[i / 8], vector_length);
@@ -255,10 +764,7 @@ void Network::process_events(uint32_t time) {
 
             vint8m1_t next_charges = __riscv_vle8_v_i8m1_m(
                 should_carryover,
-                &neuron_charge_buffer[((internal_timestep + 1) %
-                                       tracked_timesteps_count) *
-                                          allocation_size +
-                                      i],
+                &neuron_charge_buffer[next_row * allocation_size + i],
                 vector_length);
 
             next_charges =
@@ -266,10 +772,7 @@ void Network::process_events(uint32_t time) {
 
             __riscv_vse8_v_i8m1_m(
                 should_carryover,
-                &neuron_charge_buffer[((internal_timestep + 1) %
-                                       tracked_timesteps_count) *
-                                          allocation_size +
-                                      i],
+                &neuron_charge_buffer[next_row * allocation_size + i],
                 next_charges, vector_length);
         }
 
@@ -284,29 +787,42 @@ void Network::process_events(uint32_t time) {
                 output_fire_count[i + j]++;
             }
 
-            size_t num_outgoing = synapse_to[i + j].size();
+            size_t start = synapse_offsets[i + j];
+            size_t num_outgoing = synapse_offsets[i + j + 1] - start;
+            if (synapse_serial[i + j]) {
+                deliver_serial(i + j, internal_timestep);
+                continue;
+            }
             for (size_t k = 0; k < num_outgoing; k += max_vector_length) {
                 size_t vector_length =
                     min((size_t)max_vector_length, num_outgoing - k);
 
                 vint8m1_t weights = __riscv_vle8_v_i8m1(
-                    &synapse_weight[i + j][k], vector_length);
+                    &synapse_weight[start + k], vector_length);
                 vuint8m1_t delays = __riscv_vle8_v_u8m1(
-                    &synapse_delay[i + j][k], vector_length);
-                vuint16m2_t destinations =
-                    __riscv_vle16_v_u16m2(&synapse_to[i + j][k], vector_length);
+                    &synapse_delay[start + k], vector_length);
+                vuint32m4_t destinations = __riscv_vle32_v_u32m4(
+                    &synapse_to[start + k], vector_length);
 
-                vuint16m2_t indexes = __riscv_vwaddu_vx_u16m2(
+                vuint16m2_t rows = __riscv_vwaddu_vx_u16m2(
                     delays, (uint16_t)internal_timestep, vector_length);
-                indexes = __riscv_vremu_vx_u16m2(
-                    indexes, tracked_timesteps_count, vector_length);
-
+                if (ring_is_power_of_two) {
+                    rows = __riscv_vand_vx_u16m2(
+                        rows, tracked_timesteps_count - 1, vector_length);
+                } else {
+                    rows = __riscv_vremu_vx_u16m2(
+                        rows, tracked_timesteps_count, vector_length);
+                }
+
+                // Widen before multiplying, as row * allocation_size does not
+                // fit in 16 bits for large networks. Charges are one byte, so
+                // these indexes are also byte offsets.
                 // vmadd.vx vd, rs1, vs2, vm | vd[i] = (x[rs1] * vd[i]) + vs2[i]
-                indexes =
-                    __riscv_vmadd_vx_u16m2(indexes, (uint16_t)allocation_size,
-                                           destinations, vector_length);
-                vuint32m4_t final_indexes = __riscv_vwmulu_vx_u32m4(
-                    indexes, sizeof(*neuron_charge_buffer), vector_length);
+                vuint32m4_t final_indexes =
+                    __riscv_vzext_vf2_u32m4(rows, vector_length);
+                final_indexes = __riscv_vmadd_vx_u32m4(
+                    final_indexes, (uint32_t)allocation_size, destinations,
+                    vector_length);
 
                 vint8m1_t downstream_charges = __riscv_vloxei32_v_i8m1(
                     neuron_charge_buffer, final_indexes, vector_length);
@@ -322,6 +838,7 @@ void Network::process_events(uint32_t time) {
 #endif
 #ifdef RISCVV_FIRED
     const size_t max_vector_length = __riscv_vsetvlmax_e8m1();
+    const size_t next_row = (internal_timestep + 1) % tracked_timesteps_count;
     for (size_t i = 0; i < neuron_count; i += max_vector_length) {
         size_t vector_length = min(max_vector_length, neuron_count - i);
 
@@ -329,7 +846,7 @@ void Network::process_events(uint32_t time) {
             &neuron_charge_buffer[(internal_timestep * allocation_size) + i],
             vector_length);
         vint8m1_t min_potential_vec =
-            __riscv_vmv_v_x_i8m1(min_potential, vector_length);
+            __riscv_vmv_v_x_i8m1(min_potential_charge, vector_length);
         charges =
             __riscv_vmax_vv_i8m1(charges, min_potential_vec, vector_length);
         vint8m1_t thresholds =
@@ -338,6 +855,8 @@ void Network::process_events(uint32_t time) {
         vbool8_t fired =
             __riscv_vmsge_vv_i8m1_b8(charges, thresholds, vector_length);
 
+        __riscv_vsm_v_b8(&fired_bitmap[i / 8], fired, vector_length);
+
         if (leak_mode != 'a') {
             vbool8_t leak =
                 __riscv_vlm_v_b8(&neuron_leak[i / 8], vector_length);
@@ -346,10 +865,7 @@ void Network::process_events(uint32_t time) {
 
             vint8m1_t next_charges = __riscv_vle8_v_i8m1_m(
                 should_carryover,
-                &neuron_charge_buffer[((internal_timestep + 1) %
-                                       tracked_timesteps_count) *
-                                          allocation_size +
-                                      i],
+                &neuron_charge_buffer[next_row * allocation_size + i],
                 vector_length);
 
             next_charges =
@@ -357,10 +873,7 @@ void Network::process_events(uint32_t time) {
 
             __riscv_vse8_v_i8m1_m(
                 should_carryover,
-                &neuron_charge_buffer[((internal_timestep + 1) %
-                                       tracked_timesteps_count) *
-                                          allocation_size +
-                                      i],
+                &neuron_charge_buffer[next_row * allocation_size + i],
                 next_charges, vector_length);
         }
 
@@ -375,19 +888,19 @@ void Network::process_events(uint32_t time) {
                 output_fire_count[i + j]++;
             }
 
-            for (size_t k = 0; k < synapse_to[i + j].size(); k++) {
-                neuron_charge_buffer[((internal_timestep +
-                                       synapse_delay[i + j][k]) %
+            for (size_t k = synapse_offsets[i + j];
+                 k < synapse_offsets[i + j + 1]; k++) {
+                neuron_charge_buffer[((internal_timestep + synapse_delay[k]) %
                                       tracked_timesteps_count) *
                                          allocation_size +
-                                     synapse_to[i + j][k]] +=
-                    synapse_weight[i + j][k];
+                                     synapse_to[k]] += synapse_weight[k];
             }
         }
     }
 #endif
 #ifdef RISCVV_SYNAPSES
     const size_t max_vector_length = __riscv_vsetvlmax_e8m1();
+    const size_t next_row = (internal_timestep + 1) % tracked_timesteps_count;
     for (size_t i = 0; i < neuron_count; i += 1) {
         if (neuron_charge_buffer[internal_timestep * allocation_size + i] <
             min_potential) {
@@ -396,153 +909,796 @@ void Network::process_events(uint32_t time) {
         }
         if (neuron_charge_buffer[internal_timestep * allocation_size + i] >=
             neuron_threshold[i]) {
+            set_fired(fired_bitmap.data(), i);
             if (outputs[i]) {
                 output_last_fire_timestep[i] = time;
                 output_fire_count[i]++;
             }
 
-            size_t num_outgoing = synapse_to[i].size();
+            size_t start = synapse_offsets[i];
+            size_t num_outgoing = synapse_offsets[i + 1] - start;
+            if (synapse_serial[i]) {
+                deliver_serial(i, internal_timestep);
+                num_outgoing = 0;
+            }
             for (size_t k = 0; k < num_outgoing; k += max_vector_length) {
                 size_t vector_length = min(max_vector_length, num_outgoing - k);
 
-                vint8m1_t weights =
-                    __riscv_vle8_v_i8m1(&synapse_weight[i][k], vector_length);
-                vuint8m1_t delays =
-                    __riscv_vle8_v_u8m1(&synapse_delay[i][k], vector_length);
-                vuint16m2_t destinations =
-                    __riscv_vle16_v_u16m2(&synapse_to[i][k], vector_length);
+                vint8m1_t weights = __riscv_vle8_v_i8m1(
+                    &synapse_weight[start + k], vector_length);
+                vuint8m1_t delays = __riscv_vle8_v_u8m1(
+                    &synapse_delay[start + k], vector_length);
+                vuint32m4_t destinations = __riscv_vle32_v_u32m4(
+                    &synapse_to[start + k], vector_length);
 
-                vuint16m2_t indexes = __riscv_vwaddu_vx_u16m2(
+                vuint16m2_t rows = __riscv_vwaddu_vx_u16m2(
                     delays, (uint16_t)internal_timestep, vector_length);
-                indexes = __riscv_vremu_vx_u16m2(
-                    indexes, tracked_timesteps_count, vector_length);
-
-                // vmadd.vx dv, rs1, vs2, vm | vd[i] = (x[rs1] * vd[i]) + vs2[i]
-                indexes =
-                    __riscv_vmadd_vx_u16m2(indexes, (uint16_t)allocation_size,
-                                           destinations, vector_length);
-                vuint32m4_t final_indexes = __riscv_vwmulu_vx_u32m4(
-                    indexes, sizeof(*neuron_charge_buffer), vector_length);
+                if (ring_is_power_of_two) {
+                    rows = __riscv_vand_vx_u16m2(
+                        rows, tracked_timesteps_count - 1, vector_length);
+                } else {
+                    rows = __riscv_vremu_vx_u16m2(
+                        rows, tracked_timesteps_count, vector_length);
+                }
+
+                // Widen before multiplying, as row * allocation_size does not
+                // fit in 16 bits for large networks. Charges are one byte, so
+                // these indexes are also byte offsets.
+                // vmadd.vx vd, rs1, vs2, vm | vd[i] = (x[rs1] * vd[i]) + vs2[i]
+                vuint32m4_t final_indexes =
+                    __riscv_vzext_vf2_u32m4(rows, vector_length);
+                final_indexes = __riscv_vmadd_vx_u32m4(
+                    final_indexes, (uint32_t)allocation_size, destinations,
+                    vector_length);
 
                 vint8m1_t downstream_charges = __riscv_vluxei32_v_i8m1(
                     neuron_charge_buffer, final_indexes, vector_length);
                 downstream_charges = __riscv_vadd_vv_i8m1(
                     downstream_charges, weights, vector_length);
 
-                __riscv_vsuxei32_v_i8m1(neuron_charge_buffer, final_indexes,
-                                        downstream_charges, vector_length);
+                __riscv_vsuxei32_v_i8m1(neuron_charge_buffer, final_indexes,
+                                        downstream_charges, vector_length);
+            }
+        } else {
+            // If we don't leak we carry this charge over into the next
+            // timestep
+            if (!get_leak(neuron_leak, i)) {
+                neuron_charge_buffer[next_row * allocation_size + i] +=
+                    neuron_charge_buffer[internal_timestep * allocation_size +
+                                         i];
+            }
+        }
+    }
+#endif
+
+    if (frontier_enabled) {
+        record_dense_frontier(internal_timestep);
+    }
+
+    memset(&neuron_charge_buffer[(internal_timestep * allocation_size)], 0,
+           sizeof(*neuron_charge_buffer) * allocation_size);
+
+    if (frontier_enabled) {
+        clear_frontier_row(internal_timestep);
+    }
+}
+
+/** Note that `neuron`'s charge in `row` may be nonzero. Once a row has more
+ * than frontier_limit touched neurons, we stop keeping track and sweep it. */
+void Network::frontier_touch(size_t row, size_t neuron) {
+    if (frontier_dense[row]) {
+        return;
+    }
+
+    uint8_t& byte = frontier_touched[(row * allocation_size + neuron) / 8];
+    uint8_t bit = 1 << (neuron % 8);
+
+    if (byte & bit) {
+        return;
+    }
+    byte |= bit;
+    frontier[row].push_back(neuron);
+    if (frontier[row].size() > frontier_limit) {
+        frontier_dense[row] = 1;
+    }
+}
+
+/** The scalar timestep, restricted to the neurons touched in `row`. Every
+ * other neuron has a charge of zero and a positive threshold, so it neither
+ * fires nor carries anything over. */
+void Network::process_frontier(uint32_t time, size_t row) {
+    int8_t* charges = &neuron_charge_buffer[row * allocation_size];
+    size_t next_row = (row + 1) % tracked_timesteps_count;
+
+    for (size_t n = 0; n < frontier[row].size(); n++) {
+        size_t i = frontier[row][n];
+        int8_t charge = charges[i];
+
+        if (charge < min_potential) {
+            charge = min_potential;
+        }
+        if (charge >= neuron_threshold[i]) {
+            set_fired(fired_bitmap.data(), i);
+            for (size_t j = synapse_offsets[i]; j < synapse_offsets[i + 1];
+                 j++) {
+                size_t to_row =
+                    (row + synapse_delay[j]) % tracked_timesteps_count;
+
+                neuron_charge_buffer[to_row * allocation_size +
+                                     synapse_to[j]] += synapse_weight[j];
+                frontier_touch(to_row, synapse_to[j]);
+            }
+
+            if (outputs[i]) {
+                output_last_fire_timestep[i] = time;
+                output_fire_count[i]++;
+            }
+        } else if (!get_leak(neuron_leak, i) && charge != 0) {
+            neuron_charge_buffer[next_row * allocation_size + i] += charge;
+            frontier_touch(next_row, i);
+        }
+        charges[i] = 0;
+    }
+
+    clear_frontier_row(row);
+}
+
+/** Called after a dense sweep of `row`, but before the row is zeroed. The
+ * sweep has already delivered its charges, so this only recomputes who fired
+ * or carried over, and records the rows and neurons they touched. */
+void Network::record_dense_frontier(size_t row) {
+    const int8_t* charges = &neuron_charge_buffer[row * allocation_size];
+    size_t next_row = (row + 1) % tracked_timesteps_count;
+
+    for (size_t i = 0; i < neuron_count; i++) {
+        int8_t charge = charges[i];
+
+        if (charge < min_potential) {
+            charge = min_potential;
+        }
+        if (charge >= neuron_threshold[i]) {
+            for (size_t j = synapse_offsets[i]; j < synapse_offsets[i + 1];
+                 j++) {
+                frontier_touch((row + synapse_delay[j]) %
+                                   tracked_timesteps_count,
+                               synapse_to[j]);
+            }
+        } else if (!get_leak(neuron_leak, i) && charge != 0) {
+            frontier_touch(next_row, i);
+        }
+    }
+}
+
+/** Makes room in fire_history for `duration` timesteps, while tracking, and
+ * returns the first of them, or nullptr when not tracking. */
+uint8_t* Network::extend_fire_history(size_t duration) {
+    size_t base = fire_history.size();
+
+    if (tracked_neuron_count == 0 || duration == 0) {
+        return nullptr;
+    }
+    fire_history.resize(base + duration * fired_bitmap.size());
+    return &fire_history[base];
+}
+
+/** Counts this timestep's fired neurons in partition p into `fires`, and
+ * copies their part of fired_bitmap to `history` unless it is nullptr. Like
+ * RISP, a charge counts as an accumulate in the timestep that it arrives, so
+ * the charges sent now are held in the partition's slice of
+ * pending_accumulates until their row comes up, and then added to
+ * `accumulates`. Finally, clears the partition's part of fired_bitmap for the
+ * next timestep. */
+void Network::record_fires(size_t row, size_t p, uint8_t* history,
+                           long long& fires, long long& accumulates) {
+    long long* pending = &pending_accumulates[p * tracked_timesteps_count];
+    size_t begin = min(fired_bitmap.size(), p * partition_size / 8);
+    size_t end = (p + 1 == thread_count)
+                     ? fired_bitmap.size()
+                     : min(fired_bitmap.size(), begin + partition_size / 8);
+
+    accumulates += pending[row];
+    pending[row] = 0;
+
+    if (history != nullptr && begin < end) {
+        memcpy(history + begin, &fired_bitmap[begin], end - begin);
+    }
+
+    for (size_t b = begin; b < end; b++) {
+        unsigned int byte = fired_bitmap[b];
+
+        while (byte != 0) {
+            size_t i = b * 8 + __builtin_ctz(byte);
+
+            fires++;
+            for (size_t j = synapse_offsets[i]; j < synapse_offsets[i + 1];
+                 j++) {
+                pending[(row + synapse_delay[j]) % tracked_timesteps_count]++;
+            }
+            byte &= byte - 1;
+        }
+    }
+
+    if (begin < end) {
+        memset(&fired_bitmap[begin], 0, end - begin);
+    }
+}
+
+/** The threads come from `pool`. Every timestep has two phases, separated by
+ * barriers. In the first, each thread processes its own neurons, delivering
+ * charges to its own partition directly, and leaving the rest in its
+ * outboxes. In the second, each thread empties the outboxes addressed to its
+ * partition, in thread order, and records its own partition's fires. The
+ * counts are kept per thread and added up at the end. */
+void Network::run_threaded(size_t duration) {
+    uint8_t* history = extend_fire_history(duration);
+    vector<long long> fires(thread_count, 0);
+    vector<long long> accumulates(thread_count, 0);
+
+    function<void(size_t)> work = [this, duration, history, &fires,
+                                   &accumulates](size_t p) {
+        long long f = 0;
+        long long a = 0;
+
+        for (size_t i = 0; i < duration; i++) {
+            size_t row = (current_timestep + i) % tracked_timesteps_count;
+
+            (this->*partition_kernel)(i, row, p);
+            pool->sync();
+            deliver_partition(p);
+            record_fires(row, p,
+                         (history == nullptr)
+                             ? nullptr
+                             : history + i * fired_bitmap.size(),
+                         f, a);
+            pool->sync();
+        }
+        fires[p] = f;
+        accumulates[p] = a;
+    };
+
+    pool->run(work);
+    for (size_t p = 0; p < thread_count; p++) {
+        neuron_fire_counter += fires[p];
+        neuron_accum_counter += accumulates[p];
+    }
+}
+
+/** The NO_SIMD timestep. It is specialized on the leak mode, on whether
+ * min_potential is zero, and on whether the ring buffer's size is a power of
+ * two, so that none of these are tested per neuron or per synapse. The clamp
+ * to min_potential is still needed when it is zero, as negative weights and
+ * spikes can push charges below zero. */
+template <char LEAK, bool ZERO_MIN, bool POW2>
+void Network::process_dense(uint32_t time, size_t row) {
+    int8_t* charges = &neuron_charge_buffer[row * allocation_size];
+    int8_t* next_charges =
+        &neuron_charge_buffer[ring_row<POW2>(row + 1) * allocation_size];
+    const int8_t min_charge = ZERO_MIN ? 0 : min_potential_charge;
+
+    for (size_t i = 0; i < neuron_count; i++) {
+        if (charges[i] < min_charge) {
+            charges[i] = min_charge;
+        }
+        if (charges[i] >= neuron_threshold[i]) {
+            set_fired(fired_bitmap.data(), i);
+            for (size_t j = synapse_offsets[i]; j < synapse_offsets[i + 1];
+                 j++) {
+                neuron_charge_buffer[ring_row<POW2>(row + synapse_delay[j]) *
+                                         allocation_size +
+                                     synapse_to[j]] += synapse_weight[j];
+            }
+
+            // Track output count and last fire time
+            if (outputs[i]) {
+                output_last_fire_timestep[i] = time;
+                output_fire_count[i]++;
+            }
+        } else if (LEAK == 'n' ||
+                   (LEAK == 'c' && !get_leak(neuron_leak, i))) {
+            // If we don't leak we carry this charge over into the next
+            // timestep
+            next_charges[i] += charges[i];
+        }
+    }
+}
+
+/** The scalar timestep, restricted to partition p. Carry-over stays within
+ * the partition, and row `row` is not written by anyone else, so only the
+ * synapses that leave the partition need to go through an outbox. This is
+ * specialized like process_dense(). */
+template <char LEAK, bool ZERO_MIN, bool POW2>
+void Network::process_partition(uint32_t time, size_t row, size_t p) {
+    size_t begin = min(neuron_count, p * partition_size);
+    size_t end = min(neuron_count, begin + partition_size);
+    int8_t* charges = &neuron_charge_buffer[row * allocation_size];
+    size_t next_row = ring_row<POW2>(row + 1);
+    const int8_t min_charge = ZERO_MIN ? 0 : min_potential_charge;
+    vector<vector<Delivery>>& outbox = outboxes[p];
+
+    for (size_t i = begin; i < end; i++) {
+        int8_t charge = charges[i];
+
+        if (charge < min_charge) {
+            charge = min_charge;
+        }
+        if (charge >= neuron_threshold[i]) {
+            set_fired(fired_bitmap.data(), i);
+            for (size_t j = synapse_offsets[i]; j < synapse_offsets[i + 1];
+                 j++) {
+                size_t to = synapse_to[j];
+                size_t index =
+                    ring_row<POW2>(row + synapse_delay[j]) * allocation_size +
+                    to;
+
+                if (to / partition_size == p) {
+                    neuron_charge_buffer[index] += synapse_weight[j];
+                } else {
+                    outbox[to / partition_size].push_back(
+                        Delivery{index, synapse_weight[j]});
+                }
+            }
+
+            if (outputs[i]) {
+                output_last_fire_timestep[i] = time;
+                output_fire_count[i]++;
+            }
+        } else if (LEAK == 'n' ||
+                   (LEAK == 'c' && !get_leak(neuron_leak, i))) {
+            neuron_charge_buffer[next_row * allocation_size + i] += charge;
+        }
+    }
+
+    if (begin < end) {
+        memset(&charges[begin], 0, end - begin);
+    }
+}
+
+void Network::deliver_partition(size_t p) {
+    for (size_t q = 0; q < thread_count; q++) {
+        vector<Delivery>& inbox = outboxes[q][p];
+
+        for (size_t k = 0; k < inbox.size(); k++) {
+            neuron_charge_buffer[inbox[k].index] += inbox[k].weight;
+        }
+        inbox.clear();
+    }
+}
+
+void Network::clear_frontier_row(size_t row) {
+    if (frontier_dense[row]) {
+        memset(&frontier_touched[row * allocation_size / 8], 0,
+               allocation_size / 8);
+        frontier_dense[row] = 0;
+    } else {
+        for (size_t n = 0; n < frontier[row].size(); n++) {
+            size_t i = row * allocation_size + frontier[row][n];
+
+            frontier_touched[i / 8] &= ~(1 << (i % 8));
+        }
+    }
+    frontier[row].clear();
+}
+
+double Network::get_time() { return (double)current_timestep; }
+
+/** Translates a node id into its neuron index. Returns neuron_count if there
+ * is no such node. */
+size_t Network::neuron_index(uint32_t node_id) const {
+    vector<size_t>::const_iterator it = lower_bound(
+        neuron_mappings.begin(), neuron_mappings.end(), (size_t)node_id);
+
+    if (it == neuron_mappings.end() || *it != node_id) {
+        return neuron_count;
+    }
+    return it - neuron_mappings.begin();
+}
+
+bool Network::track_output_events(int output_id, bool track) {
+    if (output_id < 0 || (size_t)output_id >= output_mappings.size()) {
+        return false;
+    }
+    return track_index_events(output_mappings[output_id], track);
+}
+
+bool Network::track_neuron_events(uint32_t node_id, bool track) {
+    size_t i = neuron_index(node_id);
+
+    if (i == neuron_count) {
+        return false;
+    }
+    return track_index_events(i, track);
+}
+
+bool Network::track_index_events(size_t i, bool track) {
+    if (neuron_tracked[i] != track) {
+        neuron_tracked[i] = track;
+        if (track) {
+            tracked_neuron_count++;
+        } else {
+            tracked_neuron_count--;
+        }
+    }
+    return true;
+}
+
+double Network::output_last_fire(int output_id) {
+    return output_last_fire_timestep[output_mappings[output_id]];
+}
+vector<double> Network::output_last_fires() {
+    vector<double> return_vector;
+
+    for (size_t i = 0; i < output_mappings.size(); i++) {
+        return_vector.push_back(output_last_fire(i));
+    }
+
+    return return_vector;
+}
+
+int Network::output_count(int output_id) {
+    return output_fire_count[output_mappings[output_id]];
+}
+
+vector<int> Network::output_counts() {
+    vector<int> return_vector;
+
+    for (size_t i = 0; i < output_mappings.size(); i++) {
+        return_vector.push_back(output_count(i));
+    }
+
+    return return_vector;
+}
+
+/** Fire times are read back out of fire_history, so they are only available
+ * for neurons that are tracked. */
+vector<double> Network::output_vector(int output_id) {
+    vector<double> return_vector;
+    size_t neuron = output_mappings[output_id];
+
+    if (!neuron_tracked[neuron]) {
+        return return_vector;
+    }
+    for (size_t t = 0; t < fire_history.size() / fired_bitmap.size(); t++) {
+        if (get_fired(&fire_history[t * fired_bitmap.size()], neuron)) {
+            return_vector.push_back(t);
+        }
+    }
+
+    return return_vector;
+}
+
+vector<vector<double>> Network::output_vectors() {
+    vector<vector<double>> return_vector;
+
+    for (size_t i = 0; i < output_mappings.size(); i++) {
+        return_vector.push_back(output_vector(i));
+    }
+
+    return return_vector;
+}
+
+long long Network::total_neuron_counts() {
+    long long rv;
+
+    rv = neuron_fire_counter;
+    neuron_fire_counter = 0;
+    return rv;
+}
+
+long long Network::total_neuron_accumulates() {
+    long long rv;
+
+    rv = neuron_accum_counter;
+    neuron_accum_counter = 0;
+    return rv;
+}
+
+/** Fire counts and last fire times cover every neuron, but are only recorded
+ * while at least one neuron is tracked. Otherwise these return empty vectors,
+ * like the other processors that do not record them. */
+vector<int> Network::neuron_counts() {
+    vector<int> return_vector;
+    vector<int> counts(allocation_size, 0);
+
+    if (tracked_neuron_count == 0) {
+        return return_vector;
+    }
+    for (size_t b = 0; b < fire_history.size(); b++) {
+        unsigned int byte = fire_history[b];
+
+        while (byte != 0) {
+            counts[(b % fired_bitmap.size()) * 8 + __builtin_ctz(byte)]++;
+            byte &= byte - 1;
+        }
+    }
+
+    for (size_t i = 0; i < neuron_mappings.size(); i++) {
+        return_vector.push_back(counts[i]);
+    }
+
+    return return_vector;
+}
+
+vector<double> Network::neuron_last_fires() {
+    vector<double> return_vector;
+    vector<double> last_fires(allocation_size, -1);
+
+    if (tracked_neuron_count == 0) {
+        return return_vector;
+    }
+    for (size_t b = 0; b < fire_history.size(); b++) {
+        unsigned int byte = fire_history[b];
+
+        while (byte != 0) {
+            last_fires[(b % fired_bitmap.size()) * 8 + __builtin_ctz(byte)] =
+                b / fired_bitmap.size();
+            byte &= byte - 1;
+        }
+    }
+
+    for (size_t i = 0; i < neuron_mappings.size(); i++) {
+        return_vector.push_back(last_fires[i]);
+    }
+
+    return return_vector;
+}
+
+vector<vector<double>> Network::neuron_vectors() {
+    vector<vector<double>> fire_times(allocation_size);
+    vector<vector<double>> return_vector;
+
+    for (size_t b = 0; b < fire_history.size(); b++) {
+        unsigned int byte = fire_history[b];
+
+        while (byte != 0) {
+            size_t i = (b % fired_bitmap.size()) * 8 + __builtin_ctz(byte);
+
+            if (neuron_tracked[i]) {
+                fire_times[i].push_back(b / fired_bitmap.size());
+            }
+            byte &= byte - 1;
+        }
+    }
+
+    for (size_t i = 0; i < neuron_mappings.size(); i++) {
+        return_vector.push_back(fire_times[i]);
+    }
+
+    return return_vector;
+}
+
+vector<double> Network::neuron_charges() {
+    vector<double> return_vector;
+
+    for (size_t i = 0; i < neuron_mappings.size(); i++) {
+        return_vector.push_back(
+            neuron_charge_buffer[(current_timestep % tracked_timesteps_count) *
+                                     allocation_size +
+                                 i]);
+    }
+
+    return return_vector;
+}
+/** synapse_weights() returns three vectors, pres, posts and vals. Each entry
+ * represents a synapse weight -- pres[i] is the id of the pre-neuron, posts[i]
+ * is the id of the post-neuron, and vas[i] is the weight of the synapse.*/
+void Network::synapse_weights(vector<uint32_t>& pres, vector<uint32_t>& posts,
+                              vector<double>& vals) {
+    pres.clear();
+    posts.clear();
+    vals.clear();
+
+    for (size_t i = 0; i < neuron_count; i++) {
+        for (size_t j = synapse_offsets[i]; j < synapse_offsets[i + 1]; j++) {
+            pres.push_back(neuron_mappings[i]);
+            posts.push_back(neuron_mappings[synapse_to[j]]);
+            vals.push_back(synapse_weight[j]);
+        }
+    }
+}
+
+void Network::clear_activity() {
+    memset(neuron_charge_buffer, 0,
+           sizeof(*neuron_charge_buffer) * tracked_timesteps_count *
+               allocation_size);
+
+    if (frontier_enabled) {
+        for (size_t i = 0; i < tracked_timesteps_count; i++) {
+            frontier[i].clear();
+        }
+        fill(frontier_touched.begin(), frontier_touched.end(), 0);
+        fill(frontier_dense.begin(), frontier_dense.end(), 0);
+    }
+
+    fill(output_last_fire_timestep.begin(), output_last_fire_timestep.end(),
+         -1);
+    fill(output_fire_count.begin(), output_fire_count.end(), 0);
+    fire_history.clear();
+
+    fill(pending_accumulates.begin(), pending_accumulates.end(), 0);
+
+    current_timestep = 0;
+}
+
+void Network::clear_output_tracking() {
+    fill(output_last_fire_timestep.begin(), output_last_fire_timestep.end(),
+         -1);
+    fill(output_fire_count.begin(), output_fire_count.end(), 0);
+    fire_history.clear();
+}
+
+BatchNetwork::BatchNetwork(neuro::Network* net, double _min_potential,
+                           char leak, size_t tracked_timesteps,
+                           double _spike_value_factor, size_t _samples)
+    : Network(net, _min_potential, leak, tracked_timesteps,
+              _spike_value_factor) {
+    samples = _samples;
+    lanes = ((samples + 15) / 16) * 16;
+    row_size = neuron_count * lanes;
+
+    batch_charge_buffer = (int8_t*)aligned_alloc(
+        16, sizeof(*batch_charge_buffer) * tracked_timesteps_count * row_size);
+    memset(batch_charge_buffer, 0,
+           sizeof(*batch_charge_buffer) * tracked_timesteps_count * row_size);
+
+    fired.resize(lanes, 0);
+    output_slot.resize(neuron_count, -1);
+    for (size_t i = 0; i < output_mappings.size(); i++) {
+        output_slot[output_mappings[i]] = i;
+    }
+    batch_fire_count.resize(output_mappings.size() * lanes, 0);
+    batch_last_fire.resize(output_mappings.size() * lanes, -1);
+}
+
+BatchNetwork::~BatchNetwork() { free(batch_charge_buffer); }
+
+size_t BatchNetwork::get_samples() const { return samples; }
+
+void BatchNetwork::check_sample(size_t sample) const {
+    if (sample >= samples) {
+        throw SRE("vrisp::BatchNetwork - sample (" + to_string(sample) +
+                  ") must be < samples (" + to_string(samples) + ")");
+    }
+}
+
+void BatchNetwork::apply_spike(const Spike& s, size_t sample,
+                               bool normalized) {
+    check_sample(sample);
+
+    int32_t spike_value = spike_charge(s, normalized);
+    size_t row = (current_timestep + (size_t)s.time) % tracked_timesteps_count;
+
+    batch_charge_buffer[row * row_size + input_mappings[s.id] * lanes +
+                        sample] += spike_value;
+}
+
+void BatchNetwork::run(size_t duration) {
+    if (current_timestep != 0) {
+        clear_output_tracking();
+    }
+
+    for (size_t i = 0; i < duration; i++) {
+        process_batch(i, (current_timestep + i) % tracked_timesteps_count);
+    }
+
+    current_timestep += duration;
+
+    int8_t* charges = &batch_charge_buffer[(current_timestep %
+                                            tracked_timesteps_count) *
+                                           row_size];
+
+    for (size_t i = 0; i < row_size; i++) {
+        if (charges[i] < min_potential_charge) {
+            charges[i] = min_potential_charge;
+        }
+    }
+}
+
+/** One timestep for every sample. A neuron's charges for all of the samples
+ * are contiguous, so each step below is a simple loop over lanes, which the
+ * compiler can vectorize, and a synapse adds its weight to one contiguous
+ * block of lanes, masked by which samples fired. */
+void BatchNetwork::process_batch(uint32_t time, size_t row) {
+    int8_t* charges = &batch_charge_buffer[row * row_size];
+    int8_t* next_charges = &batch_charge_buffer[(row + 1) %
+                                                tracked_timesteps_count *
+                                                row_size];
+    const int8_t min_charge = min_potential_charge;
+    uint8_t* f = fired.data();
+
+    for (size_t i = 0; i < neuron_count; i++) {
+        int8_t* c = &charges[i * lanes];
+        const int8_t threshold = neuron_threshold[i];
+        uint8_t any_fired = 0;
+
+        for (size_t l = 0; l < lanes; l++) {
+            c[l] = (c[l] < min_charge) ? min_charge : c[l];
+            f[l] = (c[l] >= threshold);
+            any_fired |= f[l];
+        }
+
+        if (!get_leak(neuron_leak, i)) {
+            int8_t* n = &next_charges[i * lanes];
+
+            for (size_t l = 0; l < lanes; l++) {
+                n[l] += f[l] ? 0 : c[l];
+            }
+        }
+
+        if (!any_fired) {
+            continue;
+        }
+
+        for (size_t j = synapse_offsets[i]; j < synapse_offsets[i + 1]; j++) {
+            const int8_t weight = synapse_weight[j];
+            int8_t* t =
+                &batch_charge_buffer[(row + synapse_delay[j]) %
+                                         tracked_timesteps_count * row_size +
+                                     synapse_to[j] * lanes];
+
+            for (size_t l = 0; l < lanes; l++) {
+                t[l] += f[l] ? weight : 0;
             }
-        } else {
-            // If we don't leak we carry this charge over into the next
-            // timestep
-            if (!get_leak(neuron_leak, i)) {
-                neuron_charge_buffer[(internal_timestep + 1) %
-                                         tracked_timesteps_count *
-                                         allocation_size +
-                                     i] +=
-                    neuron_charge_buffer[internal_timestep * allocation_size +
-                                         i];
+        }
+
+        if (output_slot[i] != -1) {
+            uint32_t* count = &batch_fire_count[output_slot[i] * lanes];
+            int32_t* last = &batch_last_fire[output_slot[i] * lanes];
+
+            for (size_t l = 0; l < lanes; l++) {
+                count[l] += f[l];
+                last[l] = f[l] ? (int32_t)time : last[l];
             }
         }
     }
-#endif
 
-    memset(&neuron_charge_buffer[(internal_timestep * allocation_size)], 0,
-           sizeof(*neuron_charge_buffer) * allocation_size);
+    memset(charges, 0, sizeof(*charges) * row_size);
 }
 
-double Network::get_time() { return (double)current_timestep; }
-
-double Network::output_last_fire(int output_id) {
-    return output_last_fire_timestep[output_mappings[output_id]];
-}
-vector<double> Network::output_last_fires() {
-    vector<double> return_vector;
+vector<int> BatchNetwork::output_counts(size_t sample) {
+    vector<int> return_vector;
 
+    check_sample(sample);
     for (size_t i = 0; i < output_mappings.size(); i++) {
-        return_vector.push_back(output_last_fire(i));
+        return_vector.push_back(batch_fire_count[i * lanes + sample]);
     }
 
     return return_vector;
 }
 
-int Network::output_count(int output_id) {
-    return output_fire_count[output_mappings[output_id]];
-}
-
-vector<int> Network::output_counts() {
-    vector<int> return_vector;
+vector<double> BatchNetwork::output_last_fires(size_t sample) {
+    vector<double> return_vector;
 
+    check_sample(sample);
     for (size_t i = 0; i < output_mappings.size(); i++) {
-        return_vector.push_back(output_count(i));
+        return_vector.push_back(batch_last_fire[i * lanes + sample]);
     }
 
     return return_vector;
 }
 
-vector<double> Network::output_vector(int output_id) {
-    (void)output_id;
-    return vector<double>{};
-}
-vector<vector<double>> Network::output_vectors() {
-    return vector<vector<double>>{};
-}
-
-long long Network::total_neuron_counts() { return -1; }
-long long Network::total_neuron_accumulates() { return -1; }
-vector<int> Network::neuron_counts() { return vector<int>{}; }
-vector<double> Network::neuron_last_fires() { return vector<double>{}; }
-vector<vector<double>> Network::neuron_vectors() {
-    return vector<vector<double>>{};
-}
-
-vector<double> Network::neuron_charges() {
+vector<double> BatchNetwork::neuron_charges(size_t sample) {
     vector<double> return_vector;
+    size_t row = current_timestep % tracked_timesteps_count;
 
-    for (size_t i = 0; i < neuron_mappings.size(); i++) {
+    check_sample(sample);
+    for (size_t i = 0; i < neuron_count; i++) {
         return_vector.push_back(
-            neuron_charge_buffer[(current_timestep % tracked_timesteps_count) *
-                                     allocation_size +
-                                 neuron_mappings[i]]);
+            batch_charge_buffer[row * row_size + i * lanes + sample]);
     }
 
     return return_vector;
 }
-/** synapse_weights() returns three vectors, pres, posts and vals. Each entry
- * represents a synapse weight -- pres[i] is the id of the pre-neuron, posts[i]
- * is the id of the post-neuron, and vas[i] is the weight of the synapse.*/
-void Network::synapse_weights(vector<uint32_t>& pres, vector<uint32_t>& posts,
-                              vector<double>& vals) {
-    pres.clear();
-    posts.clear();
-    vals.clear();
-
-    for (size_t i = 0; i < neuron_count; i++) {
-        for (size_t j = 0;
-             j < synapse_to[i].size() && j < synapse_weight[i].size(); j++) {
-            pres.push_back(i);
-            posts.push_back(synapse_to[i][j]);
-            vals.push_back(synapse_weight[i][j]);
-        }
-    }
-}
-
-void Network::clear_activity() {
-    memset(neuron_charge_buffer, 0,
-           sizeof(*neuron_charge_buffer) * tracked_timesteps_count *
-               allocation_size);
-
-    fill(output_last_fire_timestep.begin(), output_last_fire_timestep.end(),
-         -1);
-    fill(output_fire_count.begin(), output_fire_count.end(), 0);
 
+void BatchNetwork::clear_activity() {
+    memset(batch_charge_buffer, 0,
+           sizeof(*batch_charge_buffer) * tracked_timesteps_count * row_size);
+    clear_output_tracking();
     current_timestep = 0;
 }
 
-void Network::clear_output_tracking() {
-    fill(output_last_fire_timestep.begin(), output_last_fire_timestep.end(),
-         -1);
-    fill(output_fire_count.begin(), output_fire_count.end(), 0);
+void BatchNetwork::clear_output_tracking() {
+    fill(batch_fire_count.begin(), batch_fire_count.end(), 0);
+    fill(batch_last_fire.begin(), batch_last_fire.end(), -1);
 }
 
 Processor::Processor(json& params) {
@@ -552,6 +1708,13 @@ Processor::Processor(json& params) {
 
     min_delay = 1;
     leak_mode = "none";
+    sort_synapses = false;
+    frontier_density = 0;
+    threads = 1;
+    power_of_two_timesteps = false;
+    pack_networks = false;
+    network_cache = 16;
+    pack = nullptr;
 
     /* You don't have to check for these, because they are required in the
      * JSON
@@ -590,6 +1753,47 @@ Processor::Processor(json& params) {
         leak_mode = params["leak_mode"];
     }
 
+    if (params.contains("sort_synapses")) {
+        sort_synapses = params["sort_synapses"];
+    }
+
+    if (params.contains("frontier_density")) {
+        frontier_density = params["frontier_density"];
+    }
+
+    if (params.contains("threads")) {
+        if (params["threads"] < 1) {
+            throw SRE("Reading processor json - threads must be >= 1.");
+        }
+        threads = params["threads"];
+    }
+
+    if (params.contains("power_of_two_timesteps")) {
+        power_of_two_timesteps = params["power_of_two_timesteps"];
+    }
+
+    if (params.contains("pack_networks")) {
+        pack_networks = params["pack_networks"];
+    }
+
+    if (params.contains("network_cache")) {
+        if (params["network_cache"] < 0) {
+            throw SRE("Reading processor json - network_cache must be >= 0.");
+        }
+        network_cache = params["network_cache"];
+    }
+    topology_cache.set_capacity(network_cache);
+
+    /* A power-of-two ring buffer lets the kernels wrap rows with a mask. */
+    if (power_of_two_timesteps) {
+        size_t rounded = 1;
+
+        while (rounded < tracked_timesteps_count) {
+            rounded *= 2;
+        }
+        tracked_timesteps_count = rounded;
+    }
+
     if (leak_mode != "all" && leak_mode != "none" &&
         leak_mode != "configurable") {
         throw SRE("Reading processor json - bad leak_mode. Must be all, none "
@@ -625,6 +1829,16 @@ Processor::Processor(json& params) {
         throw SRE("Reading processor json - min_potential must be <= 0.");
     }
 
+    if (frontier_density < 0 || frontier_density > 1) {
+        throw SRE("Reading processor json - frontier_density must be in "
+                  "[0,1].");
+    }
+
+    if (threads > 1 && frontier_density != 0) {
+        throw SRE("Reading processor json - frontier_density cannot be used "
+                  "with threads > 1.");
+    }
+
     /* Have the saved parameters include all of the default information. The
      * reason is that this way, if defaults change, you can still have this
      * information stored. */
@@ -639,18 +1853,28 @@ Processor::Processor(json& params) {
     saved_params["tracked_timesteps"] = tracked_timesteps_count;
 
     saved_params["leak_mode"] = leak_mode;
+    saved_params["sort_synapses"] = sort_synapses;
+    saved_params["frontier_density"] = frontier_density;
+    saved_params["threads"] = threads;
+    saved_params["power_of_two_timesteps"] = power_of_two_timesteps;
+    saved_params["pack_networks"] = pack_networks;
+    saved_params["network_cache"] = network_cache;
 }
 
 Processor::~Processor() {
     map<int, vrisp::Network*>::const_iterator it;
     for (it = networks.begin(); it != networks.end(); ++it)
         delete it->second;
+
+    map<int, vrisp::BatchNetwork*>::const_iterator bit;
+    for (bit = batches.begin(); bit != batches.end(); ++bit)
+        delete bit->second;
+
+    delete pack;
 }
 
-bool Processor::load_network(neuro::Network* net, int network_id) {
-    vrisp::Network* vrisp_net;
+bool Processor::check_network(neuro::Network* net, const string& rln) {
     string error = "";
-    string rln = "vrisp::load_network() - ";
 
     /* Error Check properties */
     if (!net->is_node_property("Threshold")) {
@@ -676,11 +1900,44 @@ bool Processor::load_network(neuro::Network* net, int network_id) {
         return false;
     }
 
+    return true;
+}
+
+bool Processor::load_network(neuro::Network* net, int network_id) {
+    vrisp::Network* vrisp_net;
+    shared_ptr<Topology> t;
+    uint64_t key = 0;
+
+    if (!check_network(net, "vrisp::load_network() - ")) {
+        return false;
+    }
+
     if (networks.find(network_id) != networks.end())
         delete networks[network_id];
+    if (get_packed(network_id) != nullptr) {
+        clear(network_id);
+    }
 
-    vrisp_net = new vrisp::Network(net, min_potential, leak_mode[0],
-                                   tracked_timesteps_count, spike_value_factor);
+    /* A network that we have compiled before shares its topology. */
+    if (network_cache > 0) {
+        key = net->content_hash();
+        t = topology_cache.get(key);
+    }
+    if (t != nullptr && t->neuron_mappings.size() == (size_t)net->num_nodes() &&
+        t->synapse_to.size() == net->num_edges()) {
+        vrisp_net = new vrisp::Network(t, min_potential, leak_mode[0],
+                                       tracked_timesteps_count,
+                                       spike_value_factor, frontier_density,
+                                       threads);
+    } else {
+        vrisp_net = new vrisp::Network(net, min_potential, leak_mode[0],
+                                       tracked_timesteps_count,
+                                       spike_value_factor, sort_synapses,
+                                       frontier_density, threads);
+        if (network_cache > 0) {
+            topology_cache.put(key, vrisp_net->get_topology());
+        }
+    }
 
     networks[network_id] = vrisp_net;
 
@@ -688,6 +1945,10 @@ bool Processor::load_network(neuro::Network* net, int network_id) {
 }
 
 bool Processor::load_networks(std::vector<neuro::Network*>& n) {
+    if (pack_networks) {
+        return pack_loaded_networks(n);
+    }
+
     for (size_t i = 0; i < n.size(); i++) {
         if (load_network(n[i], i) == false) {
             for (size_t j = 0; j <= i; j++) {
@@ -702,13 +1963,195 @@ bool Processor::load_networks(std::vector<neuro::Network*>& n) {
     return true;
 }
 
+/** Merge the networks into one neuro::Network, whose nodes are renumbered
+ * densely, network after network, and load that as the pack. */
+bool Processor::pack_loaded_networks(std::vector<neuro::Network*>& n) {
+    neuro::Network merged;
+    map<int, PackedNetwork> layout;
+    size_t node_base = 0;
+    size_t input_base = 0;
+    size_t output_base = 0;
+
+    merged.set_properties(get_network_properties());
+
+    for (size_t i = 0; i < n.size(); i++) {
+        PackedNetwork& pn = layout[i];
+        map<uint32_t, uint32_t> renumber;
+        const neuro::Network* cnet = n[i];
+        EdgeMap::const_iterator eit;
+
+        if (!check_network(n[i], "vrisp::load_networks() - ")) {
+            return false;
+        }
+
+        n[i]->make_sorted_node_vector();
+        pn.node_base = node_base;
+        pn.input_base = input_base;
+        pn.output_base = output_base;
+        pn.num_inputs = n[i]->num_inputs();
+        pn.num_outputs = n[i]->num_outputs();
+
+        for (size_t j = 0; j < n[i]->sorted_node_vector.size(); j++) {
+            Node* node = n[i]->sorted_node_vector[j];
+
+            renumber[node->id] = node_base + j;
+            merged.add_node(node_base + j)->values = node->values;
+            pn.node_ids.push_back(node->id);
+        }
+        for (size_t j = 0; j < pn.num_inputs; j++) {
+            merged.add_input(renumber[cnet->get_input(j)->id]);
+        }
+        for (size_t j = 0; j < pn.num_outputs; j++) {
+            merged.add_output(renumber[cnet->get_output(j)->id]);
+        }
+        for (eit = cnet->edges_begin(); eit != cnet->edges_end(); ++eit) {
+            const Edge* edge = eit->second.get();
+
+            merged.add_edge(renumber[edge->from->id], renumber[edge->to->id])
+                ->values = edge->values;
+        }
+
+        node_base += pn.node_ids.size();
+        input_base += pn.num_inputs;
+        output_base += pn.num_outputs;
+    }
+
+    for (size_t i = 0; i < n.size(); i++) {
+        if (networks.find(i) != networks.end()) {
+            delete networks[i];
+            networks.erase(i);
+        }
+    }
+    delete pack;
+    pack = nullptr;
+    packed.clear();
+
+    if (n.empty()) {
+        return true;
+    }
+
+    pack = new vrisp::Network(&merged, min_potential, leak_mode[0],
+                              tracked_timesteps_count, spike_value_factor,
+                              sort_synapses, frontier_density, threads);
+    packed.swap(layout);
+
+    return true;
+}
+
+bool Processor::load_batch(neuro::Network* net, size_t samples,
+                           int batch_id) {
+    if (samples == 0) {
+        throw SRE("vrisp::Processor::load_batch() - samples must be > 0.");
+    }
+    if (!check_network(net, "vrisp::load_batch() - ")) {
+        return false;
+    }
+
+    if (batches.find(batch_id) != batches.end()) {
+        delete batches[batch_id];
+    }
+    batches[batch_id] =
+        new vrisp::BatchNetwork(net, min_potential, leak_mode[0],
+                                tracked_timesteps_count, spike_value_factor,
+                                samples);
+
+    return true;
+}
+
+void Processor::clear_batch(int batch_id) {
+    vrisp::BatchNetwork* batch = get_batch(batch_id);
+    batches.erase(batch_id);
+    delete batch;
+}
+
+void Processor::apply_batch_spike(const Spike& s, size_t sample,
+                                  bool normalized, int batch_id) {
+    get_batch(batch_id)->apply_spike(s, sample, normalized);
+}
+
+void Processor::run_batch(double duration, int batch_id) {
+    if (duration < 0) {
+        throw SRE(
+            "vrisp::Processor::run_batch called with a negative duration (" +
+            to_string(duration) + ").");
+    }
+
+    get_batch(batch_id)->run(static_cast<size_t>(duration));
+}
+
+vector<int> Processor::batch_output_counts(size_t sample, int batch_id) {
+    return get_batch(batch_id)->output_counts(sample);
+}
+
+vector<double> Processor::batch_output_last_fires(size_t sample,
+                                                  int batch_id) {
+    return get_batch(batch_id)->output_last_fires(sample);
+}
+
+vector<double> Processor::batch_neuron_charges(size_t sample, int batch_id) {
+    return get_batch(batch_id)->neuron_charges(sample);
+}
+
+void Processor::clear_batch_activity(int batch_id) {
+    get_batch(batch_id)->clear_activity();
+}
+
+/* Translating between a packed network's ids and the pack's. */
+
+template <typename T>
+static vector<T> slice(const vector<T>& v, size_t start, size_t count) {
+    return vector<T>(v.begin() + start, v.begin() + start + count);
+}
+
+static size_t packed_index(const PackedNetwork& pn, uint32_t node_id) {
+    vector<uint32_t>::const_iterator it;
+
+    it = lower_bound(pn.node_ids.begin(), pn.node_ids.end(), node_id);
+    if (it == pn.node_ids.end() || *it != node_id) {
+        return pn.node_ids.size();
+    }
+    return it - pn.node_ids.begin();
+}
+
+static int packed_input(const PackedNetwork& pn, int input_id) {
+    if (input_id < 0 || (size_t)input_id >= pn.num_inputs) {
+        throw SRE("vrisp::Processor::apply_spike() - input " +
+                  to_string(input_id) + " does not exist.");
+    }
+    return input_id + pn.input_base;
+}
+
+static int packed_output(const PackedNetwork& pn, int output_id) {
+    if (output_id < 0 || (size_t)output_id >= pn.num_outputs) {
+        throw SRE("vrisp::Processor - output " + to_string(output_id) +
+                  " does not exist.");
+    }
+    return output_id + pn.output_base;
+}
+
 void Processor::clear(int network_id) {
+    if (packed.erase(network_id) != 0) {
+        if (packed.empty()) {
+            delete pack;
+            pack = nullptr;
+        }
+        return;
+    }
+
     vrisp::Network* vrisp_net = get_vrisp_network(network_id);
     networks.erase(network_id);
     delete vrisp_net;
 }
 
 void Processor::apply_spike(const Spike& s, bool normalize, int network_id) {
+    const PackedNetwork* pn = get_packed(network_id);
+
+    if (pn != nullptr) {
+        Spike packed_spike(packed_input(*pn, s.id), s.time, s.value);
+
+        pack->apply_spike(packed_spike, normalize);
+        return;
+    }
     get_vrisp_network(network_id)->apply_spike(s, normalize);
 }
 
@@ -721,9 +2164,18 @@ void Processor::apply_spike(const Spike& s, const vector<int>& network_ids,
 
 void Processor::apply_spikes(const vector<Spike>& s, bool normalize,
                              int network_id) {
-    for (size_t i = 0; i < s.size(); i++) {
-        apply_spike(s[i], normalize, network_id);
+    const PackedNetwork* pn = get_packed(network_id);
+
+    if (pn != nullptr) {
+        vector<Spike> packed_spikes(s);
+
+        for (size_t i = 0; i < packed_spikes.size(); i++) {
+            packed_spikes[i].id = packed_input(*pn, s[i].id);
+        }
+        pack->apply_spikes(packed_spikes, normalize);
+        return;
     }
+    get_vrisp_network(network_id)->apply_spikes(s, normalize);
 }
 
 void Processor::apply_spikes(const vector<Spike>& s,
@@ -733,94 +2185,238 @@ void Processor::apply_spikes(const vector<Spike>& s,
     }
 }
 
+void Processor::apply_spikes(const vector<int>& input_ids,
+                             const vector<double>& times,
+                             const vector<double>& values, bool normalize,
+                             int network_id) {
+    const PackedNetwork* pn = get_packed(network_id);
+
+    if (pn != nullptr) {
+        vector<int> packed_ids(input_ids.size());
+
+        for (size_t i = 0; i < input_ids.size(); i++) {
+            packed_ids[i] = packed_input(*pn, input_ids[i]);
+        }
+        pack->apply_spikes(packed_ids, times, values, normalize);
+        return;
+    }
+    get_vrisp_network(network_id)->apply_spikes(input_ids, times, values,
+                                                normalize);
+}
+
 void Processor::run(double duration, int network_id) {
+    run(duration, vector<int>(1, network_id));
+}
+
+/** Packed networks share one clock, so they can only be run all at once, with
+ * a single sweep of the pack. */
+void Processor::run(double duration, const vector<int>& network_ids) {
+    size_t packed_ids = 0;
+
     if (duration < 0) {
         throw SRE("vrisp::Processor::run called with a negative duration (" +
                   to_string(duration) + ").");
     }
 
-    get_vrisp_network(network_id)->run(static_cast<size_t>(duration));
-}
+    for (size_t i = 0; i < network_ids.size(); i++) {
+        if (get_packed(network_ids[i]) != nullptr) {
+            packed_ids++;
+        } else {
+            get_vrisp_network(network_ids[i]);
+        }
+    }
+    if (packed_ids != 0 && packed_ids != packed.size()) {
+        throw SRE("vrisp::Processor::run - the networks loaded with "
+                  "load_networks() are packed, and must all be run together.");
+    }
 
-void Processor::run(double duration, const vector<int>& network_ids) {
+    if (packed_ids != 0) {
+        pack->run(static_cast<size_t>(duration));
+    }
     for (size_t i = 0; i < network_ids.size(); i++) {
-        run(duration, network_ids[i]);
+        if (get_packed(network_ids[i]) == nullptr) {
+            get_vrisp_network(network_ids[i])
+                ->run(static_cast<size_t>(duration));
+        }
     }
 }
 
+/* With packed networks, the totals cover the whole pack. */
+
 long long Processor::total_neuron_counts(int network_id) {
+    if (get_packed(network_id) != nullptr) {
+        return pack->total_neuron_counts();
+    }
     return get_vrisp_network(network_id)->total_neuron_counts();
 }
 
 long long Processor::total_neuron_accumulates(int network_id) {
+    if (get_packed(network_id) != nullptr) {
+        return pack->total_neuron_accumulates();
+    }
     return get_vrisp_network(network_id)->total_neuron_accumulates();
 }
 
 double Processor::get_time(int network_id) {
+    if (get_packed(network_id) != nullptr) {
+        return pack->get_time();
+    }
     return get_vrisp_network(network_id)->get_time();
 }
 
 bool Processor::track_output_events(int output_id, bool track, int network_id) {
-    (void)output_id;
-    (void)track;
-    (void)network_id;
-    return false;
+    const PackedNetwork* pn = get_packed(network_id);
+
+    if (pn != nullptr) {
+        if (output_id < 0 || (size_t)output_id >= pn->num_outputs) {
+            return false;
+        }
+        return pack->track_output_events(output_id + pn->output_base, track);
+    }
+    return get_vrisp_network(network_id)->track_output_events(output_id, track);
 }
 
 bool Processor::track_neuron_events(uint32_t node_id, bool track,
                                     int network_id) {
-    (void)node_id;
-    (void)track;
-    (void)network_id;
-    return false;
+    const PackedNetwork* pn = get_packed(network_id);
+
+    if (pn != nullptr) {
+        size_t i = packed_index(*pn, node_id);
+
+        if (i == pn->node_ids.size()) {
+            return false;
+        }
+        return pack->track_neuron_events(pn->node_base + i, track);
+    }
+    return get_vrisp_network(network_id)->track_neuron_events(node_id, track);
 }
 
 double Processor::output_last_fire(int output_id, int network_id) {
+    const PackedNetwork* pn = get_packed(network_id);
+
+    if (pn != nullptr) {
+        return pack->output_last_fire(packed_output(*pn, output_id));
+    }
     return get_vrisp_network(network_id)->output_last_fire(output_id);
 }
 
 vector<double> Processor::output_last_fires(int network_id) {
+    const PackedNetwork* pn = get_packed(network_id);
+
+    if (pn != nullptr) {
+        return slice(pack->output_last_fires(), pn->output_base,
+                     pn->num_outputs);
+    }
     return get_vrisp_network(network_id)->output_last_fires();
 }
 
 int Processor::output_count(int output_id, int network_id) {
+    const PackedNetwork* pn = get_packed(network_id);
+
+    if (pn != nullptr) {
+        return pack->output_count(packed_output(*pn, output_id));
+    }
     return get_vrisp_network(network_id)->output_count(output_id);
 }
 
 vector<int> Processor::output_counts(int network_id) {
+    const PackedNetwork* pn = get_packed(network_id);
+
+    if (pn != nullptr) {
+        return slice(pack->output_counts(), pn->output_base, pn->num_outputs);
+    }
     return get_vrisp_network(network_id)->output_counts();
 }
 
 vector<double> Processor::output_vector(int output_id, int network_id) {
+    const PackedNetwork* pn = get_packed(network_id);
+
+    if (pn != nullptr) {
+        return pack->output_vector(packed_output(*pn, output_id));
+    }
     return get_vrisp_network(network_id)->output_vector(output_id);
 }
 
 vector<vector<double>> Processor::output_vectors(int network_id) {
+    const PackedNetwork* pn = get_packed(network_id);
+
+    if (pn != nullptr) {
+        return slice(pack->output_vectors(), pn->output_base, pn->num_outputs);
+    }
     return get_vrisp_network(network_id)->output_vectors();
 }
 
 vector<int> Processor::neuron_counts(int network_id) {
+    const PackedNetwork* pn = get_packed(network_id);
+
+    if (pn != nullptr) {
+        return slice(pack->neuron_counts(), pn->node_base,
+                     pn->node_ids.size());
+    }
     return get_vrisp_network(network_id)->neuron_counts();
 }
 
 vector<vector<double>> Processor::neuron_vectors(int network_id) {
+    const PackedNetwork* pn = get_packed(network_id);
+
+    if (pn != nullptr) {
+        return slice(pack->neuron_vectors(), pn->node_base,
+                     pn->node_ids.size());
+    }
     return get_vrisp_network(network_id)->neuron_vectors();
 }
 
 vector<double> Processor::neuron_charges(int network_id) {
+    const PackedNetwork* pn = get_packed(network_id);
+
+    if (pn != nullptr) {
+        return slice(pack->neuron_charges(), pn->node_base,
+                     pn->node_ids.size());
+    }
     return get_vrisp_network(network_id)->neuron_charges();
 }
 
 vector<double> Processor::neuron_last_fires(int network_id) {
+    const PackedNetwork* pn = get_packed(network_id);
+
+    if (pn != nullptr) {
+        return slice(pack->neuron_last_fires(), pn->node_base,
+                     pn->node_ids.size());
+    }
     return get_vrisp_network(network_id)->neuron_last_fires();
 }
 
 void Processor::synapse_weights(vector<uint32_t>& pre, vector<uint32_t>& posts,
                                 vector<double>& vals, int network_id) {
+    const PackedNetwork* pn = get_packed(network_id);
+
+    if (pn != nullptr) {
+        vector<uint32_t> all_pres, all_posts;
+        vector<double> all_vals;
+        size_t end = pn->node_base + pn->node_ids.size();
+
+        pre.clear();
+        posts.clear();
+        vals.clear();
+        pack->synapse_weights(all_pres, all_posts, all_vals);
+        for (size_t i = 0; i < all_pres.size(); i++) {
+            if (all_pres[i] >= pn->node_base && all_pres[i] < end) {
+                pre.push_back(pn->node_ids[all_pres[i] - pn->node_base]);
+                posts.push_back(pn->node_ids[all_posts[i] - pn->node_base]);
+                vals.push_back(all_vals[i]);
+            }
+        }
+        return;
+    }
     return get_vrisp_network(network_id)->synapse_weights(pre, posts, vals);
 }
 
+/** With packed networks, this clears the whole pack. */
 void Processor::clear_activity(int network_id) {
+    if (get_packed(network_id) != nullptr) {
+        pack->clear_activity();
+        return;
+    }
     get_vrisp_network(network_id)->clear_activity();
 }
 
@@ -873,4 +2469,23 @@ Network* Processor::get_vrisp_network(int network_id) {
     return it->second;
 }
 
+vrisp::BatchNetwork* Processor::get_batch(int batch_id) {
+    map<int, vrisp::BatchNetwork*>::iterator it;
+
+    it = batches.find(batch_id);
+    if (it == batches.end()) {
+        throw SRE("vrisp::Processor::get_batch() batch_id " +
+                  to_string(batch_id) + " does not exist");
+    }
+
+    return it->second;
+}
+
+const PackedNetwork* Processor::get_packed(int network_id) const {
+    map<int, PackedNetwork>::const_iterator it;
+
+    it = packed.find(network_id);
+    return (it == packed.end()) ? nullptr : &it->second;
+}
+
 } // namespace vrisp
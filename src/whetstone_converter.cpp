@@ -767,21 +767,15 @@ void Model::calculate() {
 }
 
 void Model::write_network(const string &path) {
-  json j;
-  string s;
-  FILE *fp;
+  std::ofstream fout;
 
-  fp = fopen(path.c_str(), "w+");
-  if (fp != nullptr) {
-    net->to_json(j);
-    s = j.dump();
-    fprintf(fp, "%s", s.c_str());
-  } else {
+  fout.open(path.c_str());
+  if (fout.fail()) {
     printf("Failed to open %s\n", path.c_str());
     return;
   }
 
-  fclose(fp);
+  net->write_json(fout);
 }
 
 void Model::load_weights(const json &p_weights) { //take thresholds as input
@@ -0,0 +1 @@
+sed 's/^{/{ "network_cache": 2,/' params/risp_1_plus.txt
@@ -0,0 +1 @@
+cat params/risp_1_plus.txt
@@ -0,0 +1 @@
+sed 's/"min_potential": -127/"min_potential": -200/' params/vrisp_127.json
@@ -0,0 +1 @@
+sed 's/^{/{ "frontier_density": 1.0,/' params/vrisp_1_plus.json
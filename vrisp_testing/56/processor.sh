@@ -0,0 +1 @@
+sed 's/^{/{ "threads": 3,/' params/vrisp_1_plus.json
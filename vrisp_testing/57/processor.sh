@@ -0,0 +1,2 @@
+sed 's/"min_potential": -64/"min_potential": -1/' params/vrisp_64.json |
+     sed 's/^{/{ "threads": 4,/'
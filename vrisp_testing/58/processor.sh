@@ -0,0 +1 @@
+sed '/tracked_timesteps/s/16/20/' params/vrisp_1_plus.json
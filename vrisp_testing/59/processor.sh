@@ -0,0 +1,2 @@
+sed '/tracked_timesteps/s/16/20/' params/vrisp_1_plus.json |
+     sed 's/^{/{ "power_of_two_timesteps": true,/'
@@ -0,0 +1 @@
+cat params/vrisp_1_plus.json
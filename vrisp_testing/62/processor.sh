@@ -0,0 +1 @@
+sed 's/^{/{ "pack_networks": true,/' params/vrisp_1_plus.json
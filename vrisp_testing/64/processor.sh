@@ -0,0 +1 @@
+sed 's/^{/{ "network_cache": 2,/' params/vrisp_1_plus.json
@@ -0,0 +1 @@
+sed 's/^{/{ "threads": 4,/' params/vrisp_1_plus.json
@@ -0,0 +1 @@
+cat params/vrisp_127.json